@@ -0,0 +1,180 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <avr/eeprom.h>
+#include <string.h>
+#include "config.h"
+#include "analogcal.h"
+
+#define CURVE_POINTS	17
+
+static AnalogCal EEMEM ee_cal;
+
+// calibration as stored, or being edited by the host
+static AnalogCal cal;
+
+// compiled form. Only analogcalCompile() changes it, so edits to cal
+// take effect all at once.
+static char cal_active;
+static unsigned char curve_table[4][CURVE_POINTS];
+static unsigned char cal_center[4];
+static unsigned int gain_lo[4], gain_hi[4]; // 8.8 fixed point
+static const unsigned char cal_rest[4] = ANALOG_REST;
+
+// copy of cal being written to EEPROM, taken when saving so that
+// further edits do not end up half stored
+static AnalogCal ee_image;
+
+// next EEPROM byte to write, sizeof(AnalogCal) when idle
+static unsigned char ee_offset = sizeof(AnalogCal);
+
+/* n and result 0-255. Blend of n and n^2 weighted by curve. */
+static unsigned char curveEval(unsigned char n, unsigned char curve)
+{
+	unsigned int sq = ((unsigned int)n * n) / 255;
+
+	return ((unsigned long)n * (255 - curve) + (unsigned long)sq * curve) / 255;
+}
+
+/* Rounded up so that min and max reach 255 */
+static unsigned int gainFor(unsigned char span)
+{
+	if (!span)
+		return 0;
+	return (255L * 256 + span - 1) / span;
+}
+
+static void analogcalCompile(void)
+{
+	unsigned char i, k;
+	AxisCal *a;
+
+	cal_active = 0;
+	if (cal.magic != ANALOGCAL_MAGIC)
+		return;
+
+	for (i=0; i<4; i++) {
+		a = &cal.axis[i];
+
+		if (a->min > a->center || a->center > a->max)
+			return;
+
+		cal_center[i] = a->center;
+		gain_lo[i] = gainFor(a->center - a->min);
+		gain_hi[i] = gainFor(a->max - a->center);
+
+		for (k=0; k<CURVE_POINTS-1; k++) {
+			curve_table[i][k] = curveEval(k * 16, a->curve);
+		}
+		curve_table[i][CURVE_POINTS-1] = curveEval(255, a->curve);
+	}
+
+	cal_active = 1;
+}
+
+void analogcalInit(void)
+{
+	eeprom_read_block(&cal, &ee_cal, sizeof(AnalogCal));
+	analogcalCompile();
+}
+
+static unsigned char curveLookup(const unsigned char *t, unsigned char n)
+{
+	unsigned char k = n >> 4;
+
+	if (n == 0xff)
+		return t[CURVE_POINTS-1];
+
+	return t[k] + (((t[k+1] - t[k]) * (n & 15)) >> 4);
+}
+
+/* d * gain >> 8, saturated to 255. Done as two 8x8 multiplies (one MUL
+ * instruction each) instead of a 32 bit product through __mulsi3. */
+static unsigned char gainApply(unsigned char d, unsigned int gain)
+{
+	unsigned int n;
+
+	n = (unsigned int)d * (unsigned char)(gain >> 8);
+	if (n > 255)
+		return 255;
+	n += ((unsigned int)d * (unsigned char)gain) >> 8;
+	if (n > 255)
+		return 255;
+	return n;
+}
+
+void analogcalApply(unsigned char *axes)
+{
+	unsigned char i, v, rest, range, c;
+
+	if (!cal_active)
+		return;
+
+	for (i=0; i<4; i++) {
+		v = axes[i];
+		rest = cal_rest[i];
+
+		if (v < cal_center[i]) {
+			c = curveLookup(curve_table[i], gainApply(cal_center[i] - v, gain_lo[i]));
+			axes[i] = rest - (((unsigned int)c * rest + rest) >> 8);
+		} else {
+			c = curveLookup(curve_table[i], gainApply(v - cal_center[i], gain_hi[i]));
+			range = 255 - rest;
+			axes[i] = rest + (((unsigned int)c * range + range) >> 8);
+		}
+	}
+}
+
+AnalogCal *analogcalGet(void)
+{
+	return &cal;
+}
+
+void analogcalSetByte(unsigned char offset, unsigned char value)
+{
+	if (offset < sizeof(AnalogCal))
+		((unsigned char*)&cal)[offset] = value;
+}
+
+void analogcalSave(void)
+{
+	cal.magic = ANALOGCAL_MAGIC;
+	analogcalCompile();
+	memcpy(&ee_image, &cal, sizeof(AnalogCal));
+	ee_offset = 0;
+}
+
+void analogcalClear(void)
+{
+	memset(&cal, 0xff, sizeof(AnalogCal));
+	analogcalCompile();
+	memcpy(&ee_image, &cal, sizeof(AnalogCal));
+	ee_offset = 0;
+}
+
+void analogcalTask(void)
+{
+	if (ee_offset >= sizeof(AnalogCal))
+		return;
+	if (!eeprom_is_ready())
+		return;
+
+	eeprom_update_byte((unsigned char*)&ee_cal + ee_offset, ((unsigned char*)&ee_image)[ee_offset]);
+	ee_offset++;
+}
@@ -0,0 +1,45 @@
+#ifndef _analogcal_h__
+#define _analogcal_h__
+
+/* Calibration of the 3D pad analog axes (X, Y, right and left trigger).
+ *
+ * Raw values below center are scaled from [min, center] and those above
+ * from [center, max], then shaped by a response curve (0: linear,
+ * 255: quadratic). The rest position (0x80 for the stick, 0x00 for the
+ * triggers) is output at center.
+ *
+ * The calibration lives in EEPROM and is compiled at power-up into a
+ * gain per half axis and a 17 point curve table, so applying it costs
+ * the same for every value. Without a stored calibration, values pass
+ * through unchanged. */
+
+typedef struct {
+	unsigned char min;
+	unsigned char center;
+	unsigned char max;
+	unsigned char curve;
+} AxisCal;
+
+#define ANALOGCAL_MAGIC		0xCA
+
+typedef struct {
+	unsigned char magic;
+	AxisCal axis[4];
+} AnalogCal;
+
+void analogcalInit(void);
+
+/** Calibrate the 4 analog axes in place */
+void analogcalApply(unsigned char *axes);
+
+/* Vendor request support */
+AnalogCal *analogcalGet(void);
+void analogcalSetByte(unsigned char offset, unsigned char value);
+void analogcalSave(void);
+void analogcalClear(void);
+
+/** Writes pending EEPROM bytes, one at a time, without waiting for the
+ * EEPROM. Call from the main loop. */
+void analogcalTask(void);
+
+#endif // _analogcal_h__
@@ -0,0 +1,89 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include "analogfilter.h"
+
+static unsigned char filter_mode[ANALOG_FILTER_AXES];
+static unsigned char history[ANALOG_FILTER_AXES][2]; // for the median
+static unsigned int ema[ANALOG_FILTER_AXES]; // 8.8 fixed point
+static char seeded;
+
+void analogfilterInit(const unsigned char *modes)
+{
+	unsigned char i;
+
+	for (i=0; i<ANALOG_FILTER_AXES; i++) {
+		filter_mode[i] = modes[i];
+	}
+	analogfilterReset();
+}
+
+void analogfilterReset(void)
+{
+	seeded = 0;
+}
+
+static unsigned char median3(unsigned char a, unsigned char b, unsigned char c)
+{
+	if (a > b) {
+		if (b > c)
+			return b;
+		return a > c ? c : a;
+	}
+	if (a > c)
+		return a;
+	return b > c ? c : b;
+}
+
+void analogfilterApply(unsigned char *axes)
+{
+	unsigned char i, v, k;
+	unsigned int target;
+
+	if (!seeded) {
+		for (i=0; i<ANALOG_FILTER_AXES; i++) {
+			history[i][0] = history[i][1] = axes[i];
+			ema[i] = (unsigned int)axes[i] << 8;
+		}
+		seeded = 1;
+		return;
+	}
+
+	for (i=0; i<ANALOG_FILTER_AXES; i++) {
+		v = axes[i];
+
+		if (filter_mode[i] & ANALOG_FILTER_MEDIAN3) {
+			v = median3(history[i][0], history[i][1], v);
+			history[i][0] = history[i][1];
+			history[i][1] = axes[i];
+		}
+
+		k = filter_mode[i] & 0x0f;
+		if (k) {
+			target = (unsigned int)v << 8;
+			if (target > ema[i])
+				ema[i] += (target - ema[i] + (1<<k) - 1) >> k;
+			else
+				ema[i] -= (ema[i] - target + (1<<k) - 1) >> k;
+			v = (ema[i] + 0x80) >> 8;
+		}
+
+		axes[i] = v;
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef _analogfilter_h__
+#define _analogfilter_h__
+
+/* Fixed-point filtering of the 3D pad analog axes over successive
+ * samples. Each axis has its own mode byte:
+ *
+ *  ANALOG_FILTER_MEDIAN3  median of the last 3 samples. Removes single
+ *                         sample spikes without smoothing real motion.
+ *  ANALOG_FILTER_EMA(k)   exponential moving average, a new sample
+ *                         weighs 1/2^k (k from 1 to 4).
+ *
+ * Both can be combined, the median is taken first. Measured with
+ * tools/filtersim: samples after a 0x80 to 0xff step until the output
+ * first moves, reaches 50% and 90% and settles within 1 LSB, and the
+ * RMS error of a resting axis with +/- 2 LSB noise and 2% of 20 LSB
+ * spikes:
+ *
+ *   mode              first  50%  90%  settled   rms
+ *   NONE                0     0    0     0      3.17
+ *   MEDIAN3             1     1    1     1      1.25
+ *   EMA(1)              0     0    3     6      1.86
+ *   EMA(2)              0     2    7    15      1.25
+ *   EMA(3)              0     5   16    33      0.87
+ *   EMA(4)              0    10   34    68      0.61
+ *   MEDIAN3 | EMA(1)    1     1    4     7      0.97
+ *   MEDIAN3 | EMA(2)    1     3    8    16      0.73
+ *
+ * Multiply by the sampling period (1000 / SAMPLE_RATE_HZ ms) for the
+ * added latency: 2 ms per sample at 500 Hz, but 16.7 ms at 60 Hz, so
+ * filtering is only worth it with a higher sampling rate.
+ *
+ * No AVR dependencies, tools/filtersim.c builds it for the host. */
+
+#define ANALOG_FILTER_NONE		0x00
+#define ANALOG_FILTER_MEDIAN3	0x10
+#define ANALOG_FILTER_EMA(k)	((k) & 0x0f)
+
+#define ANALOG_FILTER_AXES		4
+
+/** \param modes One mode byte per axis */
+void analogfilterInit(const unsigned char *modes);
+
+/** Forget the history. The next sample is passed as is and seeds the
+ * filters. */
+void analogfilterReset(void);
+
+/** Filter the 4 analog axes in place. Call once per fresh sample. */
+void analogfilterApply(unsigned char *axes);
+
+#endif // _analogfilter_h__
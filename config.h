@@ -0,0 +1,177 @@
+#ifndef _config_h__
+#define _config_h__
+
+/* Compile-time options for the adapter firmware. Options that are
+ * off by default cost neither flash nor RAM when disabled. */
+
+/* Maximum number of HID reports a gamepad may expose. This sizes the
+ * report scheduler and telemetry tables. */
+#define MAX_REPORTS				4
+
+/* Maximum number of main loop tasks (see tasks.h). Sizes the telemetry
+ * tables. */
+#define MAX_TASKS				6
+
+/* Keep buttons and D-pad directions pressed since the last report was
+ * sent in the next report, so that taps shorter than the report
+ * interval still reach the host. Raises the sampling rate. */
+#define WITH_PRESS_LATCH		0
+
+/* Queue every joystick state change (with a timestamp) and send them
+ * in order, one per host poll, so that press/release order survives
+ * bursts faster than the host polls. See evqueue.h. Raises the sampling
+ * rate. Cannot be combined with WITH_PRESS_LATCH. */
+#define WITH_EVENT_QUEUE		0
+
+#if WITH_PRESS_LATCH && WITH_EVENT_QUEUE
+#error WITH_PRESS_LATCH and WITH_EVENT_QUEUE are mutually exclusive
+#endif
+
+/* Sum mouse motion until the host collects it instead of reporting
+ * only the latest delta, so that no motion is lost when the host polls
+ * slower than the mouse is read. MOUSE_ACC_LIMIT caps the backlog. */
+#define WITH_MOUSE_ACCUMULATOR	0
+#define MOUSE_ACC_LIMIT			4096
+
+/* Report mouse X/Y as 16 bit values (extended mouse report descriptor)
+ * instead of 8 bit, so that fast motion fits in a single report. */
+#define WITH_MOUSE_16BIT		0
+
+/* Rest position of the 3D pad analog axes: X, Y, right trigger, left
+ * trigger. */
+#define ANALOG_REST				{ 0x80, 0x80, 0x00, 0x00 }
+
+/* Apply the per-axis calibration stored in EEPROM (see analogcal.h) to
+ * the 3D pad analog axes. */
+#define WITH_ANALOG_CALIBRATION	0
+
+/* 3D pad in analog mode: ignore axis changes of ANALOG_HYSTERESIS or
+ * less from the reported value, and snap values within ANALOG_DEADBAND
+ * of the rest position to it. Per axis, same order as ANALOG_REST.
+ * Stops a resting pad from sending a report on every poll. */
+#define WITH_ANALOG_HYSTERESIS	0
+#define ANALOG_HYSTERESIS		{ 1, 1, 1, 1 }
+#define ANALOG_DEADBAND			{ 0, 0, 0, 0 }
+
+/* Filter the 3D pad analog axes over successive samples, after the
+ * calibration and before the hysteresis. Per axis, same order as
+ * ANALOG_REST: ANALOG_FILTER_NONE, ANALOG_FILTER_MEDIAN3 and/or
+ * ANALOG_FILTER_EMA(1 to 4). The delay each mode adds is listed in
+ * analogfilter.h. Raises the sampling rate. */
+#define WITH_ANALOG_FILTER		0
+#define ANALOG_FILTER			{ ANALOG_FILTER_MEDIAN3, ANALOG_FILTER_MEDIAN3, \
+								  ANALOG_FILTER_MEDIAN3 | ANALOG_FILTER_EMA(2), \
+								  ANALOG_FILTER_MEDIAN3 | ANALOG_FILTER_EMA(2) }
+
+/* Read the controller from the Timer2 compare interrupt instead of the
+ * main loop, so samples are taken at a steady rate whatever the main
+ * loop is doing. The interrupt is non-blocking: USB keeps priority and
+ * may only stretch a capture, which the controller protocol tolerates.
+ * The main loop decodes the newest complete frame. */
+#define WITH_SAMPLE_ISR			0
+
+/* How the main loop waits between tasks:
+ * 0: sleep until the next interrupt before each sample, then wait
+ *    100 us (the old behavior, adds up to a millisecond of delay)
+ * 1: never sleep, sample as soon as due
+ * 2: between passes, sleep until the next interrupt or until the next
+ *    periodic task is due (Timer1 compare), whichever comes first. Only
+ *    when that is at least SLEEP_MIN_US away, which must be 4 timebase
+ *    ticks or more (85 us each at 12 MHz) so that the compare cannot be
+ *    missed while it is being set up.
+ * tools/sleepsim.c compares them. */
+#define SLEEP_POLICY			0
+#define SLEEP_MIN_US			500
+
+/* Remember the controller type and read it directly, without reading
+ * the ID first. The ID is checked in the captured data instead (first
+ * nibble of a pad, ID byte of 3D pad and mouse frames). A mismatch or
+ * a timeout brings back the full detection. */
+#define WITH_TYPE_CACHE			0
+
+/* Reject reads that may have been disturbed: digital pads are read
+ * twice and both reads must match, 3D pad and mouse frames must start
+ * with their ID byte. A rejected read keeps the previous report. The
+ * telemetry counts checked and rejected reads, to tell whether the
+ * check is worth its cost (estimated at about 20 us more per pad read).
+ * Not applied in raw mode. A button pressed or released between the two
+ * pad reads is rejected too: the change is reported one sample later,
+ * and the rejected count includes these genuine changes. How often
+ * reads are rejected on real hardware has not been measured, so this
+ * is off until the counters show it is needed. */
+#define WITH_READ_CHECK			0
+
+/* After a handshake timeout (3D pad, mouse), read again up to
+ * READ_RETRIES times while less than READ_RETRY_BUDGET_US (at most
+ * 21000 us at 12 MHz, in steps of 85 us) have passed in this sample.
+ * When the read still fails, the last good report is kept for up to
+ * HOLD_LAST_GOOD samples in a row, then the controller is considered
+ * disconnected and the idle reports go out. Telemetry counts timeouts, retries and expired
+ * holds. Retries are timed with Timer0 at F_CPU/1024. */
+#define READ_RETRIES			0
+#define READ_RETRY_BUDGET_US	1000
+#define HOLD_LAST_GOOD			8
+
+/* Controller sampling rate (46 to 11718 Hz at 12 MHz): the period of
+ * the sampling task, or of Timer2 with WITH_SAMPLE_ISR. Reports
+ * still go out at the host polling rate, sampling faster only helps
+ * together with WITH_PRESS_LATCH or filtering. */
+#if WITH_PRESS_LATCH || WITH_EVENT_QUEUE || WITH_ANALOG_FILTER
+#define SAMPLE_RATE_HZ			500
+#else
+#define SAMPLE_RATE_HZ			60
+#endif
+
+/* Sample at ADAPTIVE_IDLE_RATE_HZ once no report has changed for
+ * ADAPTIVE_BURST_MS, and go back to SAMPLE_RATE_HZ on the first change.
+ * The first change is seen up to one slow period late. With
+ * WITH_SAMPLE_ISR, Timer2 cannot go below 46 Hz (at 12 MHz) and the
+ * idle rate is clamped there. The window is at most 65535 timebase
+ * ticks (5592 ms at 12 MHz, less at higher clocks). */
+#define WITH_ADAPTIVE_RATE		0
+#define ADAPTIVE_IDLE_RATE_HZ	10
+#define ADAPTIVE_BURST_MS		2000
+
+/* 2 byte joystick report for digital pads: X and Y as -1, 0 or 1 and
+ * 10 buttons, instead of 4 axes and 16 buttons in 6 bytes. Analog axes
+ * are reduced to 3 positions. 0: never, 1: always, 2: when JP1 is
+ * installed at power-up. */
+#define COMPACT_PAD_REPORT		0
+
+/* Send the nibbles read from the controller as is, in a vendor defined
+ * 8 byte report, and leave decoding to the host (see host/ and
+ * saturn_decode.h). Overrides COMPACT_PAD_REPORT and the mouse mode.
+ * 0: never, 1: always, 2: when JP2 is installed at power-up. */
+#define RAW_REPORT_MODE			0
+
+/* HID idle rate in effect until the host sends SET_IDLE: an unchanged
+ * report is sent again after this many milliseconds. 0 means reports
+ * are only sent on change. Multiple of 4, at most 1020. */
+#define HID_IDLE_DEFAULT_MS		0
+
+#if (HID_IDLE_DEFAULT_MS % 4) || (HID_IDLE_DEFAULT_MS > 1020)
+#error HID_IDLE_DEFAULT_MS must be a multiple of 4 from 0 to 1020
+#endif
+
+/* Number of recently sent interrupt payloads whose CRC is kept so that
+ * resending the same report skips the CRC computation. 11 bytes of RAM
+ * each. 0 sends through usbSetInterrupt() instead. */
+#define CRC_CACHE_ENTRIES		4
+
+/* Also build crcNibble(), a table-driven CRC16 that tools/crcbench
+ * times against usbCrc16() and the CRC cache. Not called by the
+ * firmware. */
+#define WITH_CRC_BENCHMARK		0
+
+/* Telemetry stream on interrupt endpoint 3. This adds a second, vendor
+ * specific interface, so the adapter becomes a composite device (shown
+ * as an unknown device on Windows without a driver). The telemetry block
+ * is sent every TELEMETRY_STREAM_INTERVAL_MS, 7 bytes per packet.
+ * TELEMETRY_POLL_INTERVAL is the endpoint bInterval, 10 ms is the
+ * minimum allowed for low-speed devices. Telemetry stays readable with
+ * the RQ_GET_TELEMETRY control request either way. */
+#define WITH_TELEMETRY_STREAM			0
+#define TELEMETRY_POLL_INTERVAL			10
+#define TELEMETRY_STREAM_INTERVAL_MS	250
+
+#endif // _config_h__
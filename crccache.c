@@ -0,0 +1,115 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "usbdrv.h"
+#include "crccache.h"
+#include "telemetry.h"
+
+#if CRC_CACHE_ENTRIES
+
+typedef struct {
+	unsigned char len; // 0xff: unused
+	unsigned char data[8];
+	unsigned char crc[2];
+} crc_cache_entry;
+
+static crc_cache_entry crc_cache[CRC_CACHE_ENTRIES];
+static unsigned char crc_cache_next;
+
+void crccacheInit(void)
+{
+	unsigned char i;
+
+	for (i=0; i<CRC_CACHE_ENTRIES; i++) {
+		crc_cache[i].len = 0xff;
+	}
+	crc_cache_next = 0;
+}
+
+/* \return The entry matching the payload, or NULL */
+static crc_cache_entry *crccacheLookup(const unsigned char *data, unsigned char len)
+{
+	unsigned char i;
+
+	for (i=0; i<CRC_CACHE_ENTRIES; i++) {
+		if (crc_cache[i].len == len && !memcmp(crc_cache[i].data, data, len))
+			return &crc_cache[i];
+	}
+	return NULL;
+}
+
+/* Based on usbSetInterrupt() from usbdrv.c */
+void crccacheSetInterrupt(unsigned char *data, unsigned char len)
+{
+	crc_cache_entry *e;
+	unsigned char *p = usbTxBuf1 + 1;
+
+	if (usbTxLen1 & 0x10) {	/* packet buffer was empty */
+		usbTxBuf1[0] ^= USBPID_DATA0 ^ USBPID_DATA1;	/* toggle token */
+	} else {
+		usbTxLen1 = USBPID_NAK; /* avoid sending outdated (overwritten) interrupt data */
+	}
+
+	memcpy(p, data, len);
+
+	e = crccacheLookup(data, len);
+	if (e) {
+		p[len] = e->crc[0];
+		p[len+1] = e->crc[1];
+		g_telemetry.crc_cache_hits++;
+	} else {
+		usbCrc16Append(p, len);
+
+		e = &crc_cache[crc_cache_next];
+		if (++crc_cache_next >= CRC_CACHE_ENTRIES)
+			crc_cache_next = 0;
+		e->len = len;
+		memcpy(e->data, data, len);
+		e->crc[0] = p[len];
+		e->crc[1] = p[len+1];
+		g_telemetry.crc_cache_misses++;
+	}
+
+	usbTxLen1 = len + 4;	/* len must be given including sync byte */
+}
+
+#endif // CRC_CACHE_ENTRIES
+
+#if WITH_CRC_BENCHMARK
+static const unsigned int crc_nibble_table[16] PROGMEM = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+unsigned int crcNibble(const unsigned char *data, unsigned char len)
+{
+	unsigned int crc = 0xffff;
+	unsigned char b;
+
+	while (len--) {
+		b = *data++;
+		crc = (crc >> 4) ^ pgm_read_word(&crc_nibble_table[(crc ^ b) & 0xf]);
+		crc = (crc >> 4) ^ pgm_read_word(&crc_nibble_table[(crc ^ (b >> 4)) & 0xf]);
+	}
+
+	return ~crc;
+}
+#endif // WITH_CRC_BENCHMARK
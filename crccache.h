@@ -0,0 +1,19 @@
+#ifndef _crccache_h__
+#define _crccache_h__
+
+#include "config.h"
+
+void crccacheInit(void);
+
+/** Same as usbSetInterrupt(), but the CRC of recently sent payloads is
+ * remembered so that resending an identical report (idle, held buttons)
+ * skips the CRC computation. */
+void crccacheSetInterrupt(unsigned char *data, unsigned char len);
+
+#if WITH_CRC_BENCHMARK
+/** CRC16 (USB) using a 16 entry table, one lookup per nibble. For
+ * tools/crcbench only. */
+unsigned int crcNibble(const unsigned char *data, unsigned char len);
+#endif
+
+#endif // _crccache_h__
@@ -0,0 +1,107 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <string.h>
+#include "evqueue.h"
+
+typedef struct {
+	unsigned int time;
+	unsigned char state[EVQUEUE_STATE_SIZE];
+} evqueue_entry;
+
+static evqueue_entry queue[EVQUEUE_LENGTH];
+static unsigned char head; // oldest
+static unsigned char count;
+static const unsigned char *button_mask;
+
+void evqueueInit(const unsigned char *buttons)
+{
+	button_mask = buttons;
+	head = 0;
+	count = 0;
+}
+
+char evqueueEmpty(void)
+{
+	return count == 0;
+}
+
+char evqueuePush(const unsigned char *state, unsigned int time)
+{
+	unsigned char idx, i;
+	char coalesced = 0;
+
+	if (count < EVQUEUE_LENGTH) {
+		count++;
+	} else {
+		coalesced = 1;
+	}
+
+	idx = head + count - 1;
+	if (idx >= EVQUEUE_LENGTH)
+		idx -= EVQUEUE_LENGTH;
+
+	if (!coalesced) {
+		queue[idx].time = time;
+		memcpy(queue[idx].state, state, EVQUEUE_STATE_SIZE);
+		return 0;
+	}
+
+	// When full, merge into the newest entry. Its timestamp is kept
+	// since it is the oldest input the entry now stands for.
+	for (i=0; i<EVQUEUE_STATE_SIZE; i++)
+		queue[idx].state[i] = state[i] | (queue[idx].state[i] & button_mask[i]);
+
+	return coalesced;
+}
+
+const unsigned char *evqueueOldest(unsigned int *time)
+{
+	if (!count)
+		return 0;
+
+	if (time)
+		*time = queue[head].time;
+
+	return queue[head].state;
+}
+
+const unsigned char *evqueueNewest(void)
+{
+	unsigned char idx;
+
+	if (!count)
+		return 0;
+
+	idx = head + count - 1;
+	if (idx >= EVQUEUE_LENGTH)
+		idx -= EVQUEUE_LENGTH;
+
+	return queue[idx].state;
+}
+
+void evqueuePop(void)
+{
+	if (!count)
+		return;
+
+	count--;
+	if (++head >= EVQUEUE_LENGTH)
+		head = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _evqueue_h__
+#define _evqueue_h__
+
+#include "config.h"
+
+/* FIFO of timestamped report states. Each state differs from the one
+ * before, so draining one per host poll gives the host every transition
+ * in order even when they come faster than it polls. When the queue is
+ * full, the state is merged into the newest queued one (coalesced):
+ * button bits are OR-ed so that no press is lost, the rest (axes) is
+ * replaced.
+ *
+ * No AVR dependencies, tools/evqsim.c builds it for the host. */
+
+#ifndef EVQUEUE_LENGTH
+#define EVQUEUE_LENGTH		8
+#endif
+#define EVQUEUE_STATE_SIZE	6
+
+/** \param buttons Mask of the button bits in a state, kept pressed
+ * when coalescing. Not copied. */
+void evqueueInit(const unsigned char *buttons);
+
+char evqueueEmpty(void);
+
+/** \return 1 if the queue was full and the state was coalesced */
+char evqueuePush(const unsigned char *state, unsigned int time);
+
+/** \return The oldest state, or 0 if empty. Valid until the next push. */
+const unsigned char *evqueueOldest(unsigned int *time);
+
+/** \return The most recently queued state, or 0 if empty */
+const unsigned char *evqueueNewest(void);
+
+void evqueuePop(void);
+
+#endif // _evqueue_h__
@@ -12,10 +12,21 @@ typedef struct {
 
 	void (*init)(void);
 	void (*update)(void);
-	char (*changed)(unsigned char report_id);
+	/** \return A mask of the reports which changed since they were
+	 * last sent. Bit 0 is report ID 1. */
+	unsigned char (*changed)(void);
 
-	/** \return The number of bytes written */
+	/** Copy the current report to buf (GET_REPORT). Read-only: changed()
+	 * and the interrupt endpoint are not affected.
+	 * \return The number of bytes written */
 	char (*buildReport)(unsigned char *buf, unsigned char report_id);
+
+	/** Point *report to the report to transmit and clear its changed()
+	 * bit. Avoids copying the report before
+	 * usbSetInterrupt(). The pointer is only valid until the next call
+	 * to update().
+	 * \return The report size */
+	char (*takeReport)(unsigned char **report, unsigned char report_id);
 } Gamepad;
 
 #endif // _gamepad_h__
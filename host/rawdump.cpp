@@ -0,0 +1,78 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Prints the state decoded from an adapter in raw mode.
+ *
+ * Usage: rawdump /dev/hidrawN
+ */
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "saturnraw.h"
+
+int main(int argc, char **argv)
+{
+	saturn::RawDecoder dec;
+	uint8_t report[64];
+	ssize_t n;
+	int fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: rawdump /dev/hidrawN\n");
+		return 1;
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	while ((n = read(fd, report, sizeof(report))) > 0) {
+		if (!dec.decode(report, n)) {
+			fprintf(stderr, "not a raw report (%d bytes)\n", (int)n);
+			continue;
+		}
+
+		switch (dec.type())
+		{
+			case saturn::RawDecoder::None:
+				printf("none\n");
+				break;
+			case saturn::RawDecoder::Pad:
+			case saturn::RawDecoder::Analog:
+				printf("%s x=%3d y=%3d rx=%3d rz=%3d buttons=%04x\n",
+						dec.type() == saturn::RawDecoder::Pad ? "pad" :
+							dec.pad().analog ? "3d analog" : "3d digital",
+						dec.pad().x, dec.pad().y, dec.pad().rx, dec.pad().rz,
+						dec.pad().buttons);
+				break;
+			case saturn::RawDecoder::Mouse:
+				printf("mouse dx=%4d dy=%4d buttons=%x\n",
+						dec.mouse().dx, dec.mouse().dy, dec.mouse().buttons);
+				break;
+		}
+		fflush(stdout);
+	}
+
+	close(fd);
+	return 0;
+}
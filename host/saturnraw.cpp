@@ -0,0 +1,74 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <string.h>
+#include "saturnraw.h"
+
+namespace saturn {
+
+RawDecoder::RawDecoder()
+	: m_type(None)
+{
+	memset(&m_frame, 0, sizeof(m_frame));
+	memset(&m_pad, 0, sizeof(m_pad));
+	memset(&m_mouse, 0, sizeof(m_mouse));
+}
+
+bool RawDecoder::decode(const uint8_t *report, size_t len)
+{
+	unsigned char joy[SATURN_JOY_REPORT_SIZE];
+	SaturnFrame f;
+
+	if (len < SATURN_RAW_REPORT_SIZE)
+		return false;
+	if (saturnFrameUnpack(report, &f))
+		return false;
+
+	m_frame = f;
+	m_type = static_cast<Type>(f.type);
+
+	saturnIdleJoystick(joy);
+	m_pad.analog = false;
+	memset(&m_mouse, 0, sizeof(m_mouse));
+
+	switch (m_type)
+	{
+		case Pad:
+			saturnDecodePad(&f, joy);
+			break;
+		case Analog:
+			m_pad.analog = !saturnDecodeAnalog(&f, joy);
+			break;
+		case Mouse:
+			saturnDecodeMouse(&f, &m_mouse.buttons, &m_mouse.dx, &m_mouse.dy);
+			break;
+		case None:
+			break;
+	}
+
+	m_pad.x = joy[0];
+	m_pad.y = joy[1];
+	m_pad.rx = joy[2];
+	m_pad.rz = joy[3];
+	m_pad.buttons = joy[4] | (joy[5] << 8);
+
+	return true;
+}
+
+}
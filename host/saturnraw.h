@@ -0,0 +1,73 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#ifndef _saturnraw_h__
+#define _saturnraw_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "saturn_decode.h"
+
+namespace saturn {
+
+/* Decodes the reports the adapter sends in raw mode (RAW_REPORT_MODE)
+ * with the firmware's own decoders. Buttons are in controller order,
+ * remapping is left to the application. */
+class RawDecoder
+{
+public:
+	enum Type {
+		None = SATURN_FRAME_NONE,
+		Pad = SATURN_FRAME_PAD,
+		Analog = SATURN_FRAME_ANALOG,
+		Mouse = SATURN_FRAME_MOUSE,
+	};
+
+	struct PadState {
+		uint8_t x, y, rx, rz;	// 0-255, 0x7F at rest
+		uint16_t buttons;		// bit 0: A, see saturn_decode.c
+		bool analog;			// 3D pad in analog mode
+	};
+
+	struct MouseState {
+		uint8_t buttons;		// bit 0: left
+		int dx, dy;				// Y down
+	};
+
+	RawDecoder();
+
+	/** \return false if the report is not a raw report */
+	bool decode(const uint8_t *report, size_t len);
+
+	Type type() const { return m_type; }
+	const PadState &pad() const { return m_pad; }
+	const MouseState &mouse() const { return m_mouse; }
+	const SaturnFrame &frame() const { return m_frame; }
+
+private:
+	Type m_type;
+	SaturnFrame m_frame;
+	PadState m_pad;
+	MouseState m_mouse;
+};
+
+}
+
+#endif // _saturnraw_h__
@@ -32,6 +32,37 @@
 #include "saturn.h"
 
 #include "devdesc.h"
+#include "timebase.h"
+#include "telemetry.h"
+#include "requests.h"
+#include "analogcal.h"
+#include "reportsched.h"
+#include "crccache.h"
+#include "tasks.h"
+
+/* 196 is the value this timer always had for 60 Hz (59.5 Hz at 12 MHz,
+ * the exact value would be 194), kept so the default sampling does not
+ * change. */
+#if SAMPLE_RATE_HZ == 60 && F_CPU == 12000000L
+#define SAMPLE_TIMER_OCR	196
+#else
+#define SAMPLE_TIMER_OCR	((F_CPU/1024L) / SAMPLE_RATE_HZ - 1)
+#endif
+#if SAMPLE_TIMER_OCR > 255 || SAMPLE_TIMER_OCR < 1
+#error SAMPLE_RATE_HZ out of range for Timer2
+#endif
+
+#if WITH_ADAPTIVE_RATE
+// TIMEBASE_MS_TO_TICKS(ADAPTIVE_BURST_MS) must fit in a tick_t
+#if ((F_CPU/1000L) * ADAPTIVE_BURST_MS) / TIMEBASE_PRESCALER > 65535
+#error ADAPTIVE_BURST_MS exceeds the timebase range
+#endif
+#if ((F_CPU/1024L) / ADAPTIVE_IDLE_RATE_HZ - 1) > 255
+#define IDLE_TIMER_OCR		255
+#else
+#define IDLE_TIMER_OCR		((F_CPU/1024L) / ADAPTIVE_IDLE_RATE_HZ - 1)
+#endif
+#endif
 
 static uchar *rt_usbHidReportDescriptor=NULL;
 static uchar rt_usbHidReportDescriptorSize=0;
@@ -56,9 +87,9 @@ char usbDescriptorConfiguration[] = { 0 }; // dummy
 uchar my_usbDescriptorConfiguration[] = {    /* USB configuration descriptor */
     9,          /* sizeof(usbDescriptorConfiguration): length of descriptor in bytes */
     USBDESCR_CONFIG,    /* descriptor type */
-    18 + 7 * USB_CFG_HAVE_INTRIN_ENDPOINT + 9, 0,
+    18 + 7 * USB_CFG_HAVE_INTRIN_ENDPOINT + 9 + (9 + 7) * USB_CFG_HAVE_INTRIN_ENDPOINT3, 0,
                 /* total length of data returned (including inlined descriptors) */
-    1,          /* number of interfaces in this configuration */
+    1 + USB_CFG_HAVE_INTRIN_ENDPOINT3, /* number of interfaces in this configuration */
     1,          /* index of this configuration */
     0,          /* configuration name string index */
 #if USB_CFG_IS_SELF_POWERED
@@ -94,10 +125,32 @@ uchar my_usbDescriptorConfiguration[] = {    /* USB configuration descriptor */
     8, 0,       /* maximum packet size */
     USB_CFG_INTR_POLL_INTERVAL, /* in ms */
 #endif
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+/* second interface: vendor specific telemetry stream on endpoint 3 */
+    9,          /* sizeof(usbDescrInterface): length of descriptor in bytes */
+    USBDESCR_INTERFACE, /* descriptor type */
+    1,          /* index of this interface */
+    0,          /* alternate setting for this interface */
+    1,          /* endpoints excl 0: number of endpoint descriptors to follow */
+    0xff,       /* class: vendor specific */
+    0,          /* subclass */
+    0,          /* protocol */
+    0,          /* string index for interface */
+    7,          /* sizeof(usbDescrEndpoint) */
+    USBDESCR_ENDPOINT,  /* descriptor type = endpoint */
+    0x83,       /* IN endpoint number 3 */
+    0x03,       /* attrib: Interrupt endpoint */
+    8, 0,       /* maximum packet size */
+    TELEMETRY_POLL_INTERVAL, /* in ms */
+#endif
 };
 
 static Gamepad *curGamepad;
 
+// HID idle rate per report (4 ms units, 0 = only on change)
+static uchar idle_rates[MAX_REPORTS];
+static uchar hid_protocol = 1; // report protocol
+
 
 /* ----------------------- hardware I/O abstraction ------------------------ */
 
@@ -107,8 +160,8 @@ static void hardwareInit(void)
 	 * 
 	 * Bit     Description       Direction    Level/pu 
 	 * 0       Jumpers common    Out          0
-	 * 1       JP1               In           1
-	 * 2       JP2               In           1
+	 * 1       JP1 (compact)     In           1
+	 * 2       JP2 (raw)         In           1
 	 * 3       MOSI              In           1
 	 * 4       MISO              In           1
 	 * 5       SCK               In           1
@@ -138,15 +191,23 @@ static void hardwareInit(void)
 #if defined(AT168_COMPATIBLE)
 	TCCR2A= (1<<WGM21);
     TCCR2B=(1<<CS22)|(1<<CS21)|(1<<CS20);
-    OCR2A=196;  // for 60 hz
+    OCR2A=SAMPLE_TIMER_OCR;
+#if READ_RETRIES
+	/* timer 0 counts at F_CPU/1024 to time read retries, like the
+	 * ATmega8 below */
+	TCCR0A = 0;
+	TCCR0B = (1<<CS02)|(1<<CS00);
+#endif
 #else
 	/* Configure timers */
 	/* configure timer 0 for a rate of 12M/(1024 * 256) = 45.78 Hz (~22ms) */
 	TCCR0 = 5;      /* timer 0 prescaler: 1024 */
 
 	TCCR2 = (1<<WGM21)|(1<<CS22)|(1<<CS21)|(1<<CS20);
-	OCR2 = 196; // for 60 hz
+	OCR2 = SAMPLE_TIMER_OCR;
 #endif
+
+	timebaseInit();
 }
 
 static void usbReset(void)
@@ -164,23 +225,17 @@ static void usbReset(void)
 
 static uchar    reportBuffer[16];    /* buffer for HID reports */
 
-#if defined(AT168_COMPATIBLE)
-
-#define mustPollControllers()   (TIFR2 & (1<<OCF2A))
-#define clrPollControllers()    do { TIFR2 = 1<<OCF2A; } while(0)
-
-#else
-
-#define mustPollControllers()   (TIFR & (1<<OCF2))
-#define clrPollControllers()    do { TIFR = 1<<OCF2; } while(0)
-
-#endif
-
 
 /* ------------------------------------------------------------------------- */
 /* ----------------------------- USB interface ----------------------------- */
 /* ------------------------------------------------------------------------- */
 
+static void setIdleRate(uchar idx, uchar rate)
+{
+	idle_rates[idx] = rate;
+	reportschedSetStaleLimit(idx, TIMEBASE_MS_TO_TICKS(rate * 4L));
+}
+
 
 uchar	usbFunctionDescriptor(struct usbRequest *rq)
 {
@@ -210,24 +265,257 @@ uchar	usbFunctionDescriptor(struct usbRequest *rq)
 uchar	usbFunctionSetup(uchar data[8])
 {
 	usbRequest_t    *rq = (void *)data;
+	uchar i;
 
 	usbMsgPtr = reportBuffer;
 	if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
-		if(rq->bRequest == USBRQ_HID_GET_REPORT){  /* wValue: ReportType (highbyte), ReportID (lowbyte) */
-			return curGamepad->buildReport(reportBuffer, rq->wValue.bytes[0]);
+		/* wValue: ReportType or duration (highbyte), ReportID (lowbyte) */
+		uchar id = rq->wValue.bytes[0];
+
+		switch (rq->bRequest)
+		{
+			case USBRQ_HID_GET_REPORT:
+				return curGamepad->buildReport(reportBuffer, id);
+
+			case USBRQ_HID_GET_IDLE:
+				if (id > curGamepad->num_reports)
+					return 0;
+				usbMsgPtr = &idle_rates[id ? id-1 : 0];
+				return 1;
+
+			case USBRQ_HID_SET_IDLE:
+				// Report ID 0 applies to all reports
+				for (i=0; i<curGamepad->num_reports; i++) {
+					if (!id || id == i+1)
+						setIdleRate(i, rq->wValue.bytes[1]);
+				}
+				return 0;
+
+			case USBRQ_HID_GET_PROTOCOL:
+				usbMsgPtr = &hid_protocol;
+				return 1;
+
+			case USBRQ_HID_SET_PROTOCOL:
+				// Not a boot device, the report format stays the same
+				hid_protocol = rq->wValue.bytes[0];
+				return 0;
+		}
+	}else if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR){
+		switch (rq->bRequest)
+		{
+			case RQ_GET_TELEMETRY:
+				telemetryReadStart();
+				return 0xff; // see usbFunctionRead()
+			case RQ_CLEAR_TELEMETRY:
+				telemetryClear();
+				return 0;
+#if WITH_ANALOG_CALIBRATION
+			case RQ_GET_CALIBRATION:
+				usbMsgPtr = (void*)analogcalGet();
+				return sizeof(AnalogCal);
+			case RQ_SET_CALIBRATION:
+				analogcalSetByte(rq->wIndex.bytes[0], rq->wValue.bytes[0]);
+				return 0;
+			case RQ_SAVE_CALIBRATION:
+				analogcalSave();
+				return 0;
+			case RQ_CLEAR_CALIBRATION:
+				analogcalClear();
+				return 0;
+#endif
 		}
-	}else{
-	/* no vendor specific requests implemented */
 	}
 	return 0;
 }
 
+// Only GET_TELEMETRY returns 0xff from usbFunctionSetup()
+uchar	usbFunctionRead(uchar *data, uchar len)
+{
+	return telemetryRead(data, len);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned char markChanged(void)
+{
+	unsigned char changed, mask, i;
+
+	mask = changed = curGamepad->changed();
+	for (i=0; changed; i++, changed >>= 1) {
+		if (changed & 1) {
+			reportschedMarkChanged(i);
+		}
+	}
+
+	return mask;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Main loop tasks -------------------------- */
 /* ------------------------------------------------------------------------- */
 
+static void taskUsb(void)
+{
+	wdt_reset();
+	usbPoll();
+}
+
+#if WITH_ADAPTIVE_RATE
+static char sample_slow;
+static tick_t last_activity, rate_since;
+
+static void setSampleRate(char slow)
+{
+	sample_slow = slow;
+	saturnSetSlowRate(slow);
+#if WITH_SAMPLE_ISR
+#if defined(AT168_COMPATIBLE)
+	OCR2A = slow ? IDLE_TIMER_OCR : SAMPLE_TIMER_OCR;
+#else
+	OCR2 = slow ? IDLE_TIMER_OCR : SAMPLE_TIMER_OCR;
+#endif
+#else
+	tasksSetPeriod(slow ? TIMEBASE_HZ_TO_TICKS(ADAPTIVE_IDLE_RATE_HZ) :
+							TIMEBASE_HZ_TO_TICKS(SAMPLE_RATE_HZ));
+#endif
+}
+
+/* Called after each sample with the reports that changed. */
+static void adaptRate(unsigned char changed)
+{
+	tick_t now = timebaseNow();
+
+	if (sample_slow)
+		g_telemetry.rate_slow_time += (tick_t)(now - rate_since);
+	else
+		g_telemetry.rate_fast_time += (tick_t)(now - rate_since);
+	rate_since = now;
+
+	if (changed) {
+		last_activity = now;
+		if (sample_slow) {
+			g_telemetry.rate_bursts++;
+			setSampleRate(0);
+		}
+	} else if (!sample_slow &&
+			(tick_t)(now - last_activity) >= TIMEBASE_MS_TO_TICKS(ADAPTIVE_BURST_MS)) {
+		g_telemetry.rate_idles++;
+		setSampleRate(1);
+	}
+}
+#endif
+
+static void taskSample(void)
+{
+#if WITH_SAMPLE_ISR
+	// The controller is read in the Timer2 interrupt. update()
+	// decodes new frames and returns at once when there are none.
+#elif SLEEP_POLICY == 0
+	sleep_enable();
+	sleep_cpu();
+	sleep_disable();
+	_delay_us(100);
+#endif
+
+	curGamepad->update();
+#if WITH_ADAPTIVE_RATE
+	adaptRate(markChanged());
+#else
+	markChanged();
+#endif
+}
+
+/* One report per host poll. The scheduler picks which one when several
+ * are waiting. */
+static void taskSubmit(void)
+{
+	unsigned char *report;
+	char i;
+	int len;
+
+	if (!usbInterruptIsReady())
+		return;
+
+	i = reportschedNext();
+	if (i < 0)
+		return;
+
+	len = curGamepad->takeReport(&report, i+1);
+#if CRC_CACHE_ENTRIES
+	crccacheSetInterrupt(report, len);
+#else
+	usbSetInterrupt(report, len);
+#endif
+	reportschedSent(i);
+}
+
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+// Telemetry has its own endpoint and never delays the reports.
+static void taskTelemetry(void)
+{
+	if (usbInterruptIsReady3())
+		telemetryStream();
+}
+#endif
+
+#if SLEEP_POLICY == 2
+EMPTY_INTERRUPT(TIMER1_COMPA_vect);
+
+#define SLEEP_MIN_TICKS		TIMEBASE_US_TO_TICKS(SLEEP_MIN_US)
+#if ((F_CPU/1000000L) * SLEEP_MIN_US) / TIMEBASE_PRESCALER < 4
+#error SLEEP_MIN_US must be at least 4 timebase ticks
+#endif
+
+/* Sleep until the next interrupt or the next periodic task, whichever
+ * comes first. Interrupts that arrive during a pass only set flags for
+ * the tasks, so sleeping until the next one loses nothing. Too close
+ * to the due time, arming the compare could race the counter, so the
+ * loop just keeps going. */
+static void idle(void)
+{
+	tick_t due, left;
+	char timed = tasksNextDue(&due);
+
+	if (timed) {
+		left = due - timebaseNow();
+		// overdue (the difference wrapped) or too close
+		if ((left & 0x8000) || left < SLEEP_MIN_TICKS)
+			return;
+		timebaseWakeAt(due);
+	}
+
+	sleep_enable();
+	sleep_cpu();
+	sleep_disable();
+
+	if (timed)
+		timebaseWakeCancel();
+}
+#endif
+
+#if WITH_SAMPLE_ISR
+#define SAMPLE_TASK_PERIOD		0
+#else
+#define SAMPLE_TASK_PERIOD		TIMEBASE_HZ_TO_TICKS(SAMPLE_RATE_HZ)
+#endif
+
+/* Deadlines: usbPoll() must run at least every 50 ms. A sample may not
+ * slip by a whole period. The endpoints should be refilled before the
+ * host polls them again. */
+static Task tasks[] = {
+	{ taskUsb, 0, TIMEBASE_MS_TO_TICKS(50) },
+	{ taskSample, SAMPLE_TASK_PERIOD, TIMEBASE_HZ_TO_TICKS(SAMPLE_RATE_HZ) },
+	{ taskSubmit, 0, TIMEBASE_MS_TO_TICKS(USB_CFG_INTR_POLL_INTERVAL) },
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+	{ taskTelemetry, 0, TIMEBASE_MS_TO_TICKS(TELEMETRY_POLL_INTERVAL) },
+#endif
+#if WITH_ANALOG_CALIBRATION
+	{ analogcalTask, 0, 0 },
+#endif
+};
 
 int main(void)
 {
-	char must_report = 0, first_run = 1;
 	int i;
 
 	hardwareInit();
@@ -262,72 +550,30 @@ int main(void)
 	// patch the config descriptor with the HID report descriptor size
 	my_usbDescriptorConfiguration[25] = rt_usbHidReportDescriptorSize;
 
+	telemetryInit(curGamepad->num_reports);
+	reportschedInit(curGamepad->num_reports);
+	for (i=0; i<curGamepad->num_reports; i++) {
+		setIdleRate(i, HID_IDLE_DEFAULT_MS / 4);
+	}
+#if CRC_CACHE_ENTRIES
+	crccacheInit();
+#endif
+
 	usbReset();
 	usbInit();
 	set_sleep_mode(SLEEP_MODE_IDLE);
+	tasksInit(tasks, sizeof(tasks)/sizeof(tasks[0]));
+#if WITH_ADAPTIVE_RATE
+	last_activity = rate_since = timebaseNow();
+#endif
 	sei();
 
 	
 	for(;;){	/* main event loop */
-		wdt_reset();
-
-		// this must be called at each 50 ms or less
-		usbPoll();
-
-		if (first_run) {
-			curGamepad->update();
-			first_run = 0;
-		}
-
-		if (mustPollControllers())
-		{
-			clrPollControllers();
-
-			if (!must_report)
-			{
-				sleep_enable();
-				sleep_cpu();
-				sleep_disable();
-				_delay_us(100);
-				
-				curGamepad->update();
-
-				for (i=0; i<curGamepad->num_reports; i++) {			
-					if (curGamepad->changed(i+1)) {
-						must_report |= (1<<i);
-					}
-				}
-			}
-
-		}
-		
-			
-		if(must_report)
-		{
-			
-			for (i=0; i<curGamepad->num_reports; i++) {
-				int len;
-
-				if (!(must_report & (1<<i)))
-					continue;
-
-				len = curGamepad->buildReport(reportBuffer, i+1);
-				while(!usbInterruptIsReady()) {
-					usbPoll();
-				}
-				usbSetInterrupt(reportBuffer, len);
-				must_report &= ~(1<<i);
-			}
-			
-		}
-		/*	
-		if(must_report && usbInterruptIsReady()){
-			must_report = 0;
-
-			curGamepad->buildReport(reportBuffer);
-			usbSetInterrupt(reportBuffer, curGamepad->report_size);
-		}
-*/
+		tasksRun();
+#if SLEEP_POLICY == 2
+		idle();
+#endif
 	}
 	return 0;
 }
@@ -0,0 +1,134 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include "config.h"
+#include "reportsched.h"
+#include "telemetry.h"
+
+static unsigned char num_reports;
+
+// one bit per report: changed since it was last submitted
+static unsigned char pending;
+
+// last submitted report, where the round-robin search resumes
+static unsigned char cursor;
+
+// report handed to the USB driver but not yet collected by the host
+static char in_flight = -1;
+static char in_flight_changed;
+static tick_t in_flight_since;
+
+static tick_t changed_at[MAX_REPORTS];
+static tick_t sent_at[MAX_REPORTS];
+static tick_t stale_limit[MAX_REPORTS];
+
+void reportschedInit(unsigned char n)
+{
+	unsigned char i;
+	tick_t now = timebaseNow();
+
+	num_reports = n;
+	pending = 0;
+	cursor = n - 1;
+	in_flight = -1;
+
+	for (i=0; i<n; i++) {
+		sent_at[i] = now;
+		stale_limit[i] = 0;
+	}
+}
+
+void reportschedSetStaleLimit(unsigned char idx, tick_t limit)
+{
+	stale_limit[idx] = limit;
+}
+
+void reportschedMarkChanged(unsigned char idx)
+{
+	// keep the time of the first change, latency is measured from there.
+	if (pending & (1<<idx))
+		return;
+
+	pending |= (1<<idx);
+	changed_at[idx] = timebaseNow();
+}
+
+static void reportschedDelivered(tick_t now)
+{
+	unsigned char idx;
+	tick_t latency;
+
+	if (in_flight < 0)
+		return;
+
+	idx = in_flight;
+	in_flight = -1;
+
+	g_telemetry.reports_sent[idx]++;
+
+	if (!in_flight_changed)
+		return;
+
+	latency = now - in_flight_since;
+	g_telemetry.latency_last[idx] = latency;
+	if (latency > g_telemetry.latency_max[idx])
+		g_telemetry.latency_max[idx] = latency;
+}
+
+char reportschedNext(void)
+{
+	tick_t now = timebaseNow();
+	unsigned char i, idx;
+
+	reportschedDelivered(now);
+
+	// Changed reports first, starting after the last one sent.
+	idx = cursor;
+	for (i=0; i<num_reports; i++) {
+		if (++idx >= num_reports)
+			idx = 0;
+		if (pending & (1<<idx))
+			return idx;
+	}
+
+	// Then unchanged reports which have not been delivered for too long.
+	idx = cursor;
+	for (i=0; i<num_reports; i++) {
+		if (++idx >= num_reports)
+			idx = 0;
+		if (stale_limit[idx] && (tick_t)(now - sent_at[idx]) >= stale_limit[idx])
+			return idx;
+	}
+
+	return -1;
+}
+
+void reportschedSent(unsigned char idx)
+{
+	in_flight = idx;
+	in_flight_changed = pending & (1<<idx);
+	in_flight_since = changed_at[idx];
+
+	if (!in_flight_changed)
+		g_telemetry.stale_resends++;
+
+	pending &= ~(1<<idx);
+	sent_at[idx] = timebaseNow();
+	cursor = idx;
+}
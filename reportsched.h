@@ -0,0 +1,29 @@
+#ifndef _reportsched_h__
+#define _reportsched_h__
+
+#include "timebase.h"
+
+/* Decides which report goes out next on the interrupt endpoint when
+ * more reports are waiting than the host collects. Changed reports come
+ * first, served round-robin so that one busy report cannot starve the
+ * others. Unchanged reports are resent once their staleness limit expires.
+ *
+ * Reports are identified by their index (report ID - 1). */
+
+void reportschedInit(unsigned char num_reports);
+
+/** Set the staleness limit of a report, counted from when it was last
+ * submitted. 0 (the default) disables it. */
+void reportschedSetStaleLimit(unsigned char idx, tick_t limit);
+
+void reportschedMarkChanged(unsigned char idx);
+
+/** Call only when the interrupt endpoint is ready. The previously
+ *  submitted report is then accounted as delivered.
+ * \return The index of the report to send, or -1 if none is due */
+char reportschedNext(void);
+
+/** Tell the scheduler the report was handed to usbSetInterrupt() */
+void reportschedSent(unsigned char idx);
+
+#endif // _reportsched_h__
@@ -0,0 +1,14 @@
+#ifndef _requests_h__
+#define _requests_h__
+
+/* Vendor requests (bmRequestType: vendor, device) */
+
+#define RQ_GET_TELEMETRY		0x01
+#define RQ_CLEAR_TELEMETRY		0x02
+
+#define RQ_GET_CALIBRATION		0x03 // AnalogCal structure
+#define RQ_SET_CALIBRATION		0x04 // wIndex: offset in AnalogCal, wValue: byte
+#define RQ_SAVE_CALIBRATION		0x05 // use the new calibration and store it in EEPROM
+#define RQ_CLEAR_CALIBRATION	0x06 // back to raw values, erase from EEPROM
+
+#endif // _requests_h__
@@ -23,10 +23,21 @@
 #include <avr/pgmspace.h>
 #include <string.h>
 #include "usbdrv.h"
+#include "config.h"
 #include "gamepad.h"
 #include "saturn.h"
-
+#include "telemetry.h"
+#include "timebase.h"
+#include "evqueue.h"
+#include "analogcal.h"
+#include "analogfilter.h"
+#include "saturn_decode.h"
+
+#if RAW_REPORT_MODE
+#define MAX_REPORT_SIZE			SATURN_RAW_REPORT_SIZE
+#else
 #define MAX_REPORT_SIZE			6
+#endif
 #define NUM_REPORTS				2
 
 #define JOYSTICK_REPORT_IDX		0
@@ -40,26 +51,70 @@
  * buttons 8-15
  **/
 
+#define COMPACT_REPORT_SIZE		2
+/*
+ * x (2 bits), y (2 bits), buttons 0-3
+ * buttons 4-9
+ **/
+
 #define MOUSE_REPORT_IDX		1
+#if WITH_MOUSE_16BIT
+#define MOUSE_REPORT_SIZE		5
+/*
+ * buttons
+ * x (lsb)
+ * x (msb)
+ * y (lsb)
+ * y (msb)
+ **/
+#else
 #define MOUSE_REPORT_SIZE		3	
 /*
  * buttons
  * x
  * y
  **/
+#endif
+
+// Reports decoded from the controller. These are also the reports
+// sent: usbSetInterrupt() copies them straight to the transmit buffer.
+// Decoding, sending and GET_REPORT all run in the main loop, so a
+// report is never read while half updated.
+static unsigned char new_report[NUM_REPORTS][MAX_REPORT_SIZE];
+static unsigned char compact_report[COMPACT_REPORT_SIZE];
 
-// report matching the most recent bytes from the controller
-static unsigned char last_built_report[NUM_REPORTS][MAX_REPORT_SIZE];
+#define finalReport(idx)	((idx) == JOYSTICK_REPORT_IDX && g_compact ? \
+								compact_report : new_report[idx])
 
-// the most recently reported bytes
-static unsigned char last_sent_report[NUM_REPORTS][MAX_REPORT_SIZE];
+// Report ID index in the transmit buffer, -1 before the first report
+static signed char sent_idx = -1;
+
+// one bit per report, set when the report differs from the one the
+// host has. Start with all set for an initial report.
+static unsigned char report_dirty = 0xff;
 
 static char report_sizes[NUM_REPORTS] = { JOYSTICK_REPORT_SIZE, MOUSE_REPORT_SIZE };
 static char g_mouse_detected = 0;
 static char g_mouse_mode = 0;
+static char g_digital_axes = 1; // joystick X/Y are 0x00, 0x7F or 0xFF
+static char g_compact = 0;
+static char g_raw = 0;
+
+#if WITH_ANALOG_FILTER
+static const unsigned char filter_modes[ANALOG_FILTER_AXES] = ANALOG_FILTER;
+#endif
+#if WITH_EVENT_QUEUE
+// Button bits of the joystick report, for merging in a full queue
+static const unsigned char evq_buttons[EVQUEUE_STATE_SIZE] = { 0, 0, 0, 0, 0xff, 0xff };
+static const unsigned char evq_compact_buttons[EVQUEUE_STATE_SIZE] = { 0xf0, 0xff };
+#endif
+
 static Gamepad saturnGamepad;
 
 static void saturnUpdate(void);
+#if WITH_SAMPLE_ISR
+static void samplingInit(void);
+#endif
 
 /*
  * [0] X
@@ -97,6 +152,53 @@ static const unsigned char saturnPadReport[] PROGMEM = {
     0xc0,                          // END_COLLECTION
 };
 
+/*
+ * [0] X (bits 0-1), Y (bits 2-3), Btn 0-3
+ * [1] Btn 4-9
+ */
+static const unsigned char saturnCompactReport[] PROGMEM = {
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x05,                    // USAGE (Game pad)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x30,                    //   USAGE (X)
+    0x09, 0x31,                    //   USAGE (Y)
+    0x15, 0xff,                    //   LOGICAL_MINIMUM (-1)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x02,                    //   REPORT_SIZE (2)
+    0x95, 0x02,                    //   REPORT_COUNT (2)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+	0x05, 0x09,                    //   USAGE_PAGE (Button)
+    0x19, 0x01,                    //   USAGE_MINIMUM (Button 1)
+    0x29, 0x0a,                    //   USAGE_MAXIMUM (Button 10)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, 0x0a,                    //   REPORT_COUNT (10)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x75, 0x02,                    //   REPORT_SIZE (2)
+    0x95, 0x01,                    //   REPORT_COUNT (1)
+    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
+    0xc0,                          // END_COLLECTION
+};
+
+/*
+ * [0] Frame type
+ * [1-7] Nibbles
+ * See saturn_decode.h
+ */
+static const unsigned char saturnRawReport[] PROGMEM = {
+    0x06, 0x00, 0xff,              // USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x01,                    // USAGE (Vendor Usage 1)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Vendor Usage 1)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x26, 0xff, 0x00,              //   LOGICAL_MAXIMUM (255)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x95, SATURN_RAW_REPORT_SIZE,  //   REPORT_COUNT (8)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0xc0,                          // END_COLLECTION
+};
+
 /*
  * [6] Mouse buttons
  * [7] Mouse X
@@ -131,6 +233,38 @@ static const unsigned char saturnMouseReport[] PROGMEM = {
     0xc0,                          // END_COLLECTION
 };
 
+/*
+ * Same as saturnMouseReport, with 16 bit X and Y.
+ */
+static const unsigned char saturnMouseReport16[] PROGMEM = {
+	0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Pointer)
+    0xa1, 0x00,                    //   COLLECTION (Physical)
+    0x05, 0x09,                    //     USAGE_PAGE (Button)
+    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
+    0x29, 0x04,                    //     USAGE_MAXIMUM (Button 4)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
+    0x95, 0x04,                    //     REPORT_COUNT (4)
+    0x75, 0x01,                    //     REPORT_SIZE (1)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x95, 0x01,                    //     REPORT_COUNT (1)
+    0x75, 0x04,                    //     REPORT_SIZE (4)
+    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
+    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,                    //     USAGE (X)
+    0x09, 0x31,                    //     USAGE (Y)
+    0x16, 0x01, 0x80,              //     LOGICAL_MINIMUM (-32767)
+    0x26, 0xff, 0x7f,              //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //     REPORT_SIZE (16)
+    0x95, 0x02,                    //     REPORT_COUNT (2)
+    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+    0xc0,                          //   END_COLLECTION
+    0xc0,                          // END_COLLECTION
+};
+
 const unsigned char saturnMouseDevDesc[] PROGMEM = {    /* USB device descriptor */
     18,         /* sizeof(usbDescrDevice): length of descriptor in bytes */
     USBDESCR_DEVICE,    /* descriptor type */
@@ -171,6 +305,27 @@ static inline unsigned char getDat()
 static void saturnInit(void)
 {
 	unsigned char sreg;
+
+#if COMPACT_PAD_REPORT == 1
+	g_compact = 1;
+#elif COMPACT_PAD_REPORT == 2
+	// JP1 (PB1) shorts to the jumper common (PB0, low). Read it
+	// before PORTB is reconfigured below.
+	g_compact = !(PINB & 0x02);
+#endif
+#if RAW_REPORT_MODE == 1
+	g_raw = 1;
+#elif RAW_REPORT_MODE == 2
+	// JP2 (PB2)
+	g_raw = !(PINB & 0x04);
+#endif
+	if (g_raw) {
+		g_compact = 0; // raw mode overrides it
+		report_sizes[JOYSTICK_REPORT_IDX] = SATURN_RAW_REPORT_SIZE;
+	} else if (g_compact) {
+		report_sizes[JOYSTICK_REPORT_IDX] = COMPACT_REPORT_SIZE;
+	}
+
 	sreg = SREG;
 	cli();
 	
@@ -192,14 +347,40 @@ static void saturnInit(void)
 
 	SREG = sreg;
 
+#if WITH_ANALOG_CALIBRATION
+	analogcalInit();
+#endif
+#if WITH_ANALOG_FILTER
+	analogfilterInit(filter_modes);
+#endif
+#if WITH_EVENT_QUEUE
+	// Raw reports never go through the queue (see saturnUpdate())
+	evqueueInit(g_compact ? evq_compact_buttons : evq_buttons);
+#endif
+
+#if WITH_SAMPLE_ISR
+	samplingInit();
+#endif
+
 	saturnUpdate();
 
-	if (g_mouse_detected) {
+	if (g_raw) {
+		saturnGamepad.reportDescriptor = (void*)saturnRawReport;
+		saturnGamepad.reportDescriptorSize = sizeof(saturnRawReport);
+	} else if (g_mouse_detected) {
+#if WITH_MOUSE_16BIT
+		saturnGamepad.reportDescriptor = (void*)saturnMouseReport16;
+		saturnGamepad.reportDescriptorSize = sizeof(saturnMouseReport16);
+#else
 		saturnGamepad.reportDescriptor = (void*)saturnMouseReport;
 		saturnGamepad.reportDescriptorSize = sizeof(saturnMouseReport);
+#endif
 		saturnGamepad.deviceDescriptor = (void*)saturnMouseDevDesc;
 		saturnGamepad.deviceDescriptorSize = sizeof(saturnMouseDevDesc);
 		g_mouse_mode = 1;
+	} else if (g_compact) {
+		saturnGamepad.reportDescriptor = (void*)saturnCompactReport;
+		saturnGamepad.reportDescriptorSize = sizeof(saturnCompactReport);
 	} else {
 		saturnGamepad.reportDescriptor = (void*)saturnPadReport;
 		saturnGamepad.reportDescriptorSize = sizeof(saturnPadReport);
@@ -231,21 +412,139 @@ static char inline waitTL(char state)
 
 static void idleJoystick(void)
 {
-	unsigned char *joy_report = last_built_report[JOYSTICK_REPORT_IDX];
-	joy_report[0] = 0x7F;
-	joy_report[1] = 0x7F;
-	joy_report[2] = 0x7F;
-	joy_report[3] = 0x7F;
-	joy_report[4] = 0;
-	joy_report[5] = 0;
+	saturnIdleJoystick(new_report[JOYSTICK_REPORT_IDX]);
 }
 
 static void idleMouse(void)
 {
-	unsigned char *mouse_report = last_built_report[MOUSE_REPORT_IDX];
+	unsigned char *mouse_report = new_report[MOUSE_REPORT_IDX];
 	memset(mouse_report, 0, MAX_REPORT_SIZE);
 }
 
+/* The last report the host got or is about to get: the newest queued
+ * joystick state, else what is in the transmit buffer. Comparing with
+ * it tracks changes without keeping a copy of each report.
+ * \return NULL if there is none for this report */
+static const unsigned char *sentReport(unsigned char idx)
+{
+#if WITH_EVENT_QUEUE
+	if (idx == JOYSTICK_REPORT_IDX && !evqueueEmpty())
+		return evqueueNewest();
+#endif
+	if (sent_idx == idx)
+		return usbTxBuf1 + 1; // after the PID
+	return NULL;
+}
+
+/* Mark a decoded report dirty if it differs from the one the host has,
+ * so detecting a change later is a single bit test.
+ * \return 1 if it changed */
+static char checkReport(unsigned char idx)
+{
+	const unsigned char *src = finalReport(idx);
+	const unsigned char *cur = sentReport(idx);
+	unsigned char i, diff = 0;
+
+	if (!cur) {
+		report_dirty |= (1<<idx);
+		return 1;
+	}
+
+	for (i=0; i<report_sizes[idx]; i++)
+		diff |= src[i] ^ cur[i];
+
+	if (diff)
+		report_dirty |= (1<<idx);
+	else
+		report_dirty &= ~(1<<idx);
+
+	return diff != 0;
+}
+
+#if WITH_ANALOG_HYSTERESIS
+
+static const unsigned char analog_hysteresis[4] = ANALOG_HYSTERESIS;
+static const unsigned char analog_deadband[4] = ANALOG_DEADBAND;
+static const unsigned char analog_rest[4] = ANALOG_REST;
+
+static unsigned char absDiff(unsigned char a, unsigned char b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/* Filter the analog axes of the joystick report against the values the
+ * host has. The rest position and the extremes always go through so that
+ * they are reachable.
+ *
+ * \return 1 if a change was held back */
+static char analogHysteresis(void)
+{
+	unsigned char *joy_report = new_report[JOYSTICK_REPORT_IDX];
+	const unsigned char *published = sentReport(JOYSTICK_REPORT_IDX);
+	unsigned char i, v;
+	char held = 0;
+
+	for (i=0; i<4; i++) {
+		v = joy_report[i];
+
+		if (absDiff(v, analog_rest[i]) <= analog_deadband[i])
+			v = analog_rest[i];
+
+		if (!published) {
+			joy_report[i] = v;
+			continue;
+		}
+
+		if (v != published[i] && v != analog_rest[i] && v != 0x00 && v != 0xff &&
+				absDiff(v, published[i]) <= analog_hysteresis[i]) {
+			v = published[i];
+		}
+
+		if (v != joy_report[i] && joy_report[i] != published[i])
+			held = 1;
+
+		joy_report[i] = v;
+	}
+
+	return held;
+}
+
+#endif // WITH_ANALOG_HYSTERESIS
+
+/* 2 bit X/Y value: -1, 0 or 1 */
+static unsigned char axisDirection(unsigned char v)
+{
+	if (v < 0x40)
+		return 0x03;
+	if (v > 0xbf)
+		return 0x01;
+	return 0;
+}
+
+static void compactReport(unsigned char *dst, const unsigned char *joy_report)
+{
+	unsigned char x, y;
+	unsigned int buttons;
+
+	x = axisDirection(joy_report[0]);
+	y = axisDirection(joy_report[1]);
+
+	// The 3D pad in analog mode sends its D-Pad as buttons 10-13
+	if (joy_report[5] & 0x04) // right
+		x = 0x01;
+	if (joy_report[5] & 0x08) // left
+		x = 0x03;
+	if (joy_report[5] & 0x10) // down
+		y = 0x01;
+	if (joy_report[5] & 0x20) // up
+		y = 0x03;
+
+	buttons = joy_report[4] | ((joy_report[5] & 0x03) << 8);
+
+	dst[0] = x | (y << 2) | (buttons << 4);
+	dst[1] = buttons >> 4;
+}
+
 #define MAPPING_UNDEFINED	0
 
 #define MAPPING_SLS			1
@@ -259,7 +558,7 @@ static char current_mapping = MAPPING_UNDEFINED;
 static void permuteButtons(void)
 {
 	unsigned int buttons_in, buttons_out;
-	unsigned char *joy_report = last_built_report[JOYSTICK_REPORT_IDX];
+	unsigned char *joy_report = new_report[JOYSTICK_REPORT_IDX];
 	int i;
 
 	/* Saturn		:   A  B  C  X  Y  Z  S  L  R */		 
@@ -320,90 +619,109 @@ static void permuteButtons(void)
 	joy_report[5] = buttons_out >> 8;
 }
 
-static char saturnReadMouse(void)
-{
-	unsigned char dat[32];
-	int i;
-	char tr = 0;
-	char r;
-	char digital_mode = 0;
-	int nibbles = 8;
-	unsigned char *mouse_report = last_built_report[MOUSE_REPORT_IDX];
-	unsigned char x,y;
+#if WITH_MOUSE_16BIT
+#define MOUSE_AXIS_MAX	32767
+#else
+#define MOUSE_AXIS_MAX	127
+#endif
 
-	_delay_us(4);
-	TH_LOW();
-	_delay_us(4);
-
-	for (i=0; i<nibbles; i++) {
-		if (tr) {
-			TR_HIGH();
-			r = waitTL(1);
-			if (r) 
-				return -1;
-		}
-		else {
-			TR_LOW();
-			r = waitTL(0);
-			if (r)
-				return -1;
-		}
-
-		_delay_us(2);
+static void mouseSetMotion(unsigned char *mouse_report, int x, int y)
+{
+	if (x > MOUSE_AXIS_MAX) x = MOUSE_AXIS_MAX;
+	if (x < -MOUSE_AXIS_MAX) x = -MOUSE_AXIS_MAX;
+	if (y > MOUSE_AXIS_MAX) y = MOUSE_AXIS_MAX;
+	if (y < -MOUSE_AXIS_MAX) y = -MOUSE_AXIS_MAX;
+
+#if WITH_MOUSE_16BIT
+	mouse_report[1] = x;
+	mouse_report[2] = x >> 8;
+	mouse_report[3] = y;
+	mouse_report[4] = y >> 8;
+#else
+	mouse_report[1] = x;
+	mouse_report[2] = y;
+#endif
+}
 
-		dat[i] = getDat();
+#if WITH_MOUSE_ACCUMULATOR
 
-		tr ^= 1;
+// motion read from the mouse but not yet sent (X, Y)
+static int mouse_acc[2];
 
-		if (i>=1) {
-			if (dat[1] == 0x12) {
-				digital_mode = 1;
-				nibbles = 8;
-			}
-		}
-	}
-
-	TR_HIGH();
-	_delay_us(4);
-	TH_HIGH();
-	_delay_us(4);
-
-	idleMouse();
-
-	if (dat[3] & 0x01)
-		mouse_report[0] |= 1;
-	if (dat[3] & 0x02)
-		mouse_report[0] |= 2;
-	if (dat[3] & 0x04)
-		mouse_report[0] |= 4;
-	if (dat[3] & 0x08)
-		mouse_report[0] |= 8;
+static int accAdd(int acc, int delta)
+{
+	acc += delta;
+	if (acc > MOUSE_ACC_LIMIT)
+		return MOUSE_ACC_LIMIT;
+	if (acc < -MOUSE_ACC_LIMIT)
+		return -MOUSE_ACC_LIMIT;
+	return acc;
+}
 
-	x = (dat[5]&0xf) | (dat[4]<<4);
-	y = (dat[7]&0xf) | (dat[6]<<4);
+/* Write as much of the pending motion as fits in the report */
+static void mouseFromAccumulator(void)
+{
+	mouseSetMotion(new_report[MOUSE_REPORT_IDX], mouse_acc[0], mouse_acc[1]);
+}
 
-	mouse_report[1] = x;	
-	mouse_report[2] = 256 - y;	
+/* The host got the report: remove what it contained */
+static void mouseReportSent(const unsigned char *report)
+{
+#if WITH_MOUSE_16BIT
+	mouse_acc[0] -= (int)(report[1] | ((unsigned int)report[2] << 8));
+	mouse_acc[1] -= (int)(report[3] | ((unsigned int)report[4] << 8));
+#else
+	mouse_acc[0] -= (signed char)report[1];
+	mouse_acc[1] -= (signed char)report[2];
+#endif
+}
 
-	return 0;
+#endif // WITH_MOUSE_ACCUMULATOR
+
+/* With no controller attached, only one sample in PROBE_DIVIDER reads
+ * the ID again, about once per host poll, so a controller plugged in
+ * is read before the next one. TH and TR are left high after a probe,
+ * which makes the next one a single port read. At the adaptive idle
+ * rate, every sample probes: it is already slower than the host polls. */
+#define PROBE_DIVIDER_RAW	((SAMPLE_RATE_HZ * USB_CFG_INTR_POLL_INTERVAL) / 1000)
+#if PROBE_DIVIDER_RAW > 1
+#define PROBE_DIVIDER		PROBE_DIVIDER_RAW
+#else
+#define PROBE_DIVIDER		1
+#endif
+
+/* TH and TR high for at least 4us. Cleared by whatever drives them low
+ * (even if the read then fails), set only once they are back up. */
+static char select_idle;
+// Only saturnCapture() touches it, which may run in the sample ISR
+static unsigned char probe_skip;
+#if WITH_ADAPTIVE_RATE
+// Set from the main loop, it also cancels a skip in progress
+static volatile char probe_every_sample;
+
+void saturnSetSlowRate(char slow)
+{
+	probe_every_sample = slow;
 }
 
+#define probeSkipping()		(probe_skip && !probe_every_sample)
+#else
+#define probeSkipping()		(probe_skip)
+#endif
 
-static char saturnReadAnalog(void)
+/* Read nibbles with the TR/TL handshake (3D pad and mouse) */
+static char captureNibbles(SaturnFrame *f, unsigned char count)
 {
-	unsigned char dat[32];
-	int i;
+	unsigned char i;
 	char tr = 0;
 	char r;
-	char digital_mode = 0;
-	int nibbles = 14;
-	unsigned char *joy_report = last_built_report[JOYSTICK_REPORT_IDX];
 
 	_delay_us(4);
 	TH_LOW();
+	select_idle = 0;
 	_delay_us(4);
 
-	for (i=0; i<nibbles; i++) {
+	for (i=0; i<count; i++) {
 		if (tr) {
 			TR_HIGH();
 			r = waitTL(1);
@@ -419,89 +737,26 @@ static char saturnReadAnalog(void)
 
 		_delay_us(2);
 
-		dat[i] = getDat();
+		f->nib[i] = getDat();
 
 		tr ^= 1;
 
-		if (i>=1) {
-			if (dat[1] == 0x12) {
-				digital_mode = 1;
-				nibbles = 8;
-			}
-		}
-	}
-
-	idleJoystick();
-	// dat[2]  : Up Dn Lf Rt
-	// dat[3]  : B  C  A  St
-	// dat[4]  : Z  Y  X  R
-	// dat[5]  : ?  ?  ?  L
-	
-	if (!(dat[3] & 0x04)) // A
-		joy_report[4] |= 0x01;
-	if (!(dat[3] & 0x01)) // B
-		joy_report[4] |= 0x02;
-	if (!(dat[3] & 0x02)) // C
-		joy_report[4] |= 0x04;
-
-	if (!(dat[4] & 0x04)) // X
-		joy_report[4] |= 0x08;
-	if (!(dat[4] & 0x02)) // Y
-		joy_report[4] |= 0x10;
-	if (!(dat[4] & 0x01)) // Z
-		joy_report[4] |= 0x20;
-
-	if (!(dat[3] & 0x08)) // Start
-		joy_report[4] |= 0x40;
-
-	if (!(dat[5] & 0x08)) // L
-		joy_report[4] |= 0x80;
-	if (!(dat[4] & 0x08)) // R
-		joy_report[5] |= 0x01;
-	
-	if (digital_mode) {
-		// switch is in the "+" position
-		if (!(dat[2] & 0x08)) // right
-			joy_report[0] = 0xff;
-		if (!(dat[2] & 0x04)) // left
-			joy_report[0] = 0x00;
-		if (!(dat[2] & 0x02)) // down
-			joy_report[1] = 0xff;
-		if (!(dat[2] & 0x01)) // Up
-			joy_report[1] = 0x00;
+		// 3D pad in digital mode
+		if (i == 1 && (f->nib[1] & 0x0f) == 0x02)
+			count = 8;
 	}
-	else {
-		if (!(dat[2] & 0x08)) // Right
-			joy_report[5] |= 0x04;
-		if (!(dat[2] & 0x04)) // Left
-			joy_report[5] |= 0x08;
-		if (!(dat[2] & 0x02)) // Down
-			joy_report[5] |= 0x10;
-		if (!(dat[2] & 0x01)) // Up
-			joy_report[5] |= 0x20;
-
-		// switch is in the "o" position
-		joy_report[0] = (dat[7] & 0xf) | (dat[6] << 4);
-		joy_report[1] = (dat[9] & 0xf) | (dat[8] << 4);
-		joy_report[2] = (dat[11] & 0xf) | (dat[10] << 4);
-		joy_report[3] = (dat[13] & 0xf) | (dat[12] << 4);
-	} 
-	
 
 	TR_HIGH();
 	_delay_us(4);
 	TH_HIGH();
 	_delay_us(4);
+	select_idle = 1;
 
 	return 0;
 }
 
-static void saturnReadPad(void)
+static void readPadNibbles(unsigned char *nib)
 {
-	unsigned char a,b,c,d;
-	unsigned char *joy_report = last_built_report[JOYSTICK_REPORT_IDX];
-	
-
 	// TH and TR already high from detecting, read this
 	// nibble first! Otherwise the HORIPAD SS (HSS-11) does
 	// not work! The Performance Super Pad 8 does though.
@@ -511,134 +766,623 @@ static void saturnReadPad(void)
 	TH_HIGH();
 	TR_HIGH();
 	_delay_us(4);
-	d = getDat();
-
+	nib[0] = getDat();
 
 	// d0 d1 d2 d3
 	// Z  Y  X  R	
 	TH_LOW();
 	TR_LOW();
+	select_idle = 0;
 	_delay_us(4);
-	a = getDat();
+	nib[1] = getDat();
 
 	// d0 d1 d2 d3
 	// B  C  A  St	
 	TH_HIGH();
 	TR_LOW();
 	_delay_us(4);
-	b = getDat();
+	nib[2] = getDat();
 
 	// d0 d1 d2 d3
 	// UP DN LT RT	
 	TH_LOW();
 	TR_HIGH();
 	_delay_us(4);
-	c = getDat();
+	nib[3] = getDat();
+}
 
-	idleJoystick();
+static void capturePad(SaturnFrame *f)
+{
+	readPadNibbles(f->nib);
+#if WITH_READ_CHECK
+	// again, for saturnRead() to compare
+	readPadNibbles(f->nib + 4);
+#endif
+}
 
-	if (!(c & 0x08)) // right
-		joy_report[0] = 0xff;
-	if (!(c & 0x04)) // left
-		joy_report[0] = 0x00;
-	if (!(c & 0x02)) // down
-		joy_report[1] = 0xff;
-	if (!(c & 0x01)) // Up
-		joy_report[1] = 0x00;
-
-	if (!(b & 0x04)) // A
-		joy_report[4] |= 0x01;
-	if (!(b & 0x01)) // B
-		joy_report[4] |= 0x02;
-	if (!(b & 0x02)) // C
-		joy_report[4] |= 0x04;
-
-	if (!(a & 0x04)) // X
-		joy_report[4] |= 0x08;
-	if (!(a & 0x02)) // Y
-		joy_report[4] |= 0x10;
-	if (!(a & 0x01)) // Z
-		joy_report[4] |= 0x20;
-
-	if (!(b & 0x08)) // Start
-		joy_report[4] |= 0x40;
-
-	if (!(d & 0x08)) // L
-		joy_report[4] |= 0x80;
-	if (!(a & 0x08)) // R
-		joy_report[5] |= 0x01;
+/* Handshake timeouts and retries since the main loop last collected
+ * them (written in the sampling interrupt with WITH_SAMPLE_ISR) */
+static volatile unsigned char capture_timeouts, capture_retries;
+
+#if READ_RETRIES
+#define retryClock()		TCNT0	// F_CPU/1024, see hardwareInit()
+#define RETRY_BUDGET_TICKS	((F_CPU/1000000L) * READ_RETRY_BUDGET_US / 1024)
+#if RETRY_BUDGET_TICKS > 255
+#error READ_RETRY_BUDGET_US too large
+#endif
+#endif
+
+/* captureNibbles() with up to READ_RETRIES more attempts after a
+ * timeout, as long as READ_RETRY_BUDGET_US have not passed since the
+ * first one. An attempt that has started is not cut short, so the
+ * worst case is the budget plus one attempt. */
+static char captureHandshake(SaturnFrame *f, unsigned char count)
+{
+#if READ_RETRIES
+	unsigned char start = retryClock();
+	unsigned char retries = READ_RETRIES;
+#endif
+	char r;
+
+	for (;;) {
+		r = captureNibbles(f, count);
+		if (r == 0)
+			return 0;
+
+		capture_timeouts++;
+#if !READ_RETRIES
+		return r;
+#else
+		if (!retries || (unsigned char)(retryClock() - start) >= RETRY_BUDGET_TICKS)
+			return r;
+		retries--;
+		capture_retries++;
+
+		// Back to idle so the controller restarts its sequence
+		memset(f->nib, 0, sizeof(f->nib));
+		TR_HIGH();
+		TH_HIGH();
+		_delay_us(4);
+#endif
+	}
 }
 
-static void saturnUpdate(void)
+/* Move the capture counters to telemetry. Main loop only, with the
+ * sampling interrupt masked if there is one. */
+static void collectCaptureStats(void)
 {
-	char tmp;
+	g_telemetry.read_timeouts += capture_timeouts;
+	g_telemetry.read_retries += capture_retries;
+	capture_timeouts = 0;
+	capture_retries = 0;
+}
 
-	TH_HIGH();
-	TR_HIGH();
-	_delay_us(4);
+#if WITH_TYPE_CACHE
+static unsigned char cached_type = SATURN_FRAME_NONE;
+
+/* Read the cached controller type without probing.
+ * \return 0 if read and revalidated, -1 on a timeout, 1 if the ID
+ * did not match (the cache is cleared in both cases) */
+static char captureCached(SaturnFrame *f)
+{
+	char r = 0;
+
+	memset(f, 0, sizeof(SaturnFrame));
+	f->type = cached_type;
+
+	if (cached_type == SATURN_FRAME_PAD)
+		capturePad(f);
+	else
+		r = captureHandshake(f, cached_type == SATURN_FRAME_ANALOG ? 14 : 8);
+
+	if (r == 0) {
+		if (saturnFrameIdValid(f))
+			return 0;
+		r = 1;
+	}
+
+	cached_type = SATURN_FRAME_NONE;
+	return r;
+}
+#endif
+
+/* After detection by ID, cache the type if the read worked */
+static inline char detected(const SaturnFrame *f, char r)
+{
+#if WITH_TYPE_CACHE
+	if (r == 0)
+		cached_type = f->type;
+#endif
+	return r;
+}
+
+/* Pin capture only. Must not touch 16 bit registers such as TCNT1,
+ * it may run in the sampling interrupt.
+ * \return 0, -1 if the controller stopped answering, or 1 if nothing
+ * is connected and this sample was skipped (*f untouched) */
+static char saturnCapture(SaturnFrame *f)
+{
+	unsigned char tmp;
+#if WITH_TYPE_CACHE
+	char r;
+#endif
+
+	if (probeSkipping()) {
+		probe_skip--;
+		return 1;
+	}
+
+#if WITH_TYPE_CACHE
+	if (cached_type != SATURN_FRAME_NONE) {
+		r = captureCached(f);
+		// A different device: detect it now
+		if (r != 1)
+			return r;
+	}
+#endif
+
+	memset(f, 0, sizeof(SaturnFrame));
+
+	if (!select_idle) {
+		TH_HIGH();
+		TR_HIGH();
+		_delay_us(4);
+	}
 
 	tmp = getDat();
 
 	if (tmp == 0x11) {	
-		idleMouse();
-		if (0 == saturnReadAnalog()) {
-			permuteButtons();
-		}
-		return;
+		f->type = SATURN_FRAME_ANALOG;
+		return detected(f, captureHandshake(f, 14));
 	}
 	
 	// Bit 4-0: 1L100 where 'L' is the 'L' button status
 	if ((tmp & 0x17) == 0x14) {
-		idleMouse();
-		saturnReadPad();
-		permuteButtons();
-		return;
+		f->type = SATURN_FRAME_PAD;
+		capturePad(f);
+		return detected(f, 0);
 	}
 
 	// mouse	
 	if (tmp == 0x10) {
-		idleJoystick();
-		saturnReadMouse();
-		g_mouse_detected = 1;
-		return;
+		f->type = SATURN_FRAME_MOUSE;
+		return detected(f, captureHandshake(f, 8));
+	}
+
+	// nothing connected
+	select_idle = 1;
+#if WITH_ADAPTIVE_RATE
+	if (!probe_every_sample)
+#endif
+		probe_skip = PROBE_DIVIDER - 1;
+	return 0;
+}
+
+#if WITH_SAMPLE_ISR
+
+#ifdef TIMSK2
+#define SAMPLE_vect				TIMER2_COMPA_vect
+#define sampleIntEnable()		do { TIMSK2 |= (1<<OCIE2A); } while(0)
+#define sampleIntDisable()		do { TIMSK2 &= ~(1<<OCIE2A); } while(0)
+#else
+#define SAMPLE_vect				TIMER2_COMP_vect
+#define sampleIntEnable()		do { TIMSK |= (1<<OCIE2); } while(0)
+#define sampleIntDisable()		do { TIMSK &= ~(1<<OCIE2); } while(0)
+#endif
+
+/* Triple buffer: the interrupt captures into frames[fb_back] and swaps
+ * it with fb_ready when complete. The main loop swaps fb_ready with
+ * fb_front with the sampling interrupt masked, so neither side ever
+ * sees a frame being written. */
+static SaturnFrame frames[3];
+static char frame_result[3]; // saturnCapture() return value
+static volatile unsigned char fb_back = 0, fb_ready = 1, fb_front = 2;
+static volatile char fb_fresh;
+
+/* Non-blocking so that the USB interrupt can preempt the capture.
+ * The interrupt masks itself meanwhile, a capture slower than the
+ * sampling period cannot nest. */
+ISR(SAMPLE_vect, ISR_NOBLOCK)
+{
+	unsigned char tmp;
+	char r;
+
+	sampleIntDisable();
+
+	// Failed reads are passed on too, for the hold policy
+	r = saturnCapture(&frames[fb_back]);
+	if (r <= 0) {
+		frame_result[fb_back] = r;
+		tmp = fb_ready;
+		fb_ready = fb_back;
+		fb_back = tmp;
+		fb_fresh = 1;
+	}
+
+	sampleIntEnable();
+}
+
+/* Capture the first frame now, for device detection. The interrupt
+ * takes over once interrupts are enabled by main(). */
+static void samplingInit(void)
+{
+	frame_result[fb_ready] = saturnCapture(&frames[fb_ready]);
+	fb_fresh = 1;
+
+	sampleIntEnable();
+}
+
+/* \return The newest complete frame, valid until the next call */
+static SaturnFrame *takeFrame(void)
+{
+	unsigned char tmp;
+
+	sampleIntDisable();
+	tmp = fb_front;
+	fb_front = fb_ready;
+	fb_ready = tmp;
+	fb_fresh = 0;
+	collectCaptureStats();
+	sampleIntEnable();
+
+	return &frames[fb_front];
+}
+
+#else
+
+static SaturnFrame frame;
+
+#endif // WITH_SAMPLE_ISR
+
+/* Get a frame, from the sampling interrupt or by capturing now.
+ * \return 0, -1 if the capture failed (*f is still set), or 1 if
+ * there is no controller and the previous frame was kept */
+static char saturnSample(SaturnFrame **f)
+{
+#if WITH_SAMPLE_ISR
+	*f = takeFrame();
+	return frame_result[fb_front];
+#else
+	char r;
+
+	*f = &frame;
+	r = saturnCapture(&frame);
+	collectCaptureStats();
+	return r;
+#endif
+}
+
+static void decodeMouse(const SaturnFrame *f)
+{
+	unsigned char *mouse_report = new_report[MOUSE_REPORT_IDX];
+	int dx, dy;
+
+	idleMouse();
+	saturnDecodeMouse(f, &mouse_report[0], &dx, &dy);
+
+#if WITH_MOUSE_ACCUMULATOR
+	mouse_acc[0] = accAdd(mouse_acc[0], dx);
+	mouse_acc[1] = accAdd(mouse_acc[1], dy);
+#else
+	mouseSetMotion(mouse_report, dx, dy);
+#endif
+}
+
+#if WITH_PRESS_LATCH
+
+// buttons (joystick bytes 4-5, mouse byte 0) pressed since the last
+// report was taken.
+static unsigned char latch_buttons[2];
+static unsigned char latch_mouse_buttons;
+// last D-pad direction (joystick X/Y) since the last report was taken,
+// 0x7F if none.
+static unsigned char latch_axes[2] = { 0x7F, 0x7F };
+
+static void latchPresses(void)
+{
+	unsigned char *joy_report = new_report[JOYSTICK_REPORT_IDX];
+	unsigned char *mouse_report = new_report[MOUSE_REPORT_IDX];
+	unsigned char i;
+
+	for (i=0; i<2; i++) {
+		latch_buttons[i] |= joy_report[4+i];
+		joy_report[4+i] = latch_buttons[i];
+
+		if (!g_digital_axes)
+			continue;
+		if (joy_report[i] != 0x7F)
+			latch_axes[i] = joy_report[i];
+		else
+			joy_report[i] = latch_axes[i];
 	}
 
-	// default idle
+	latch_mouse_buttons |= mouse_report[0];
+	mouse_report[0] = latch_mouse_buttons;
+}
+
+static void clearLatches(void)
+{
+	latch_buttons[0] = 0;
+	latch_buttons[1] = 0;
+	latch_axes[0] = 0x7F;
+	latch_axes[1] = 0x7F;
+	latch_mouse_buttons = 0;
+}
+
+#endif // WITH_PRESS_LATCH
+
+static char g_disconnected = 0;
+
+#if WITH_READ_CHECK
+/* A USB interrupt can stretch a phase of the read far beyond the
+ * controller timings. The pad must read the same twice, and the
+ * handshake devices must still have sent their ID byte first. A real
+ * change between the two pad reads fails the check as well, the next
+ * sample picks it up. */
+static char frameConsistent(const SaturnFrame *f)
+{
+	if (f->type == SATURN_FRAME_PAD && memcmp(f->nib, f->nib + 4, 4))
+		return 0;
+	return saturnFrameIdValid(f);
+}
+#endif
+
+/* No controller. Publish idle reports once, then nothing until one
+ * is read again.
+ * \return 0 when new_report was set to idle, 1 if already done */
+static char disconnect(void)
+{
+	if (g_disconnected)
+		return 1;
+	g_disconnected = 1;
+
+	// Presses and motion from the controller that went away are
+	// dropped, they would otherwise stay in the idle reports.
+#if WITH_PRESS_LATCH
+	clearLatches();
+#endif
+#if WITH_MOUSE_ACCUMULATOR
+	mouse_acc[0] = 0;
+	mouse_acc[1] = 0;
+#endif
+
+	g_digital_axes = 1;
 	idleJoystick();
 	idleMouse();
+	return 0;
 }
 
-static char saturnBuildReport(unsigned char *reportBuffer, unsigned char report_id)
+/* \return 0 when new_report was updated, -1 if the read failed, 1 if
+ * no controller is connected and the idle reports are already out */
+static char saturnRead(void)
+{
+	static unsigned char failed_reads;
+	SaturnFrame *f;
+	char r;
+
+	r = saturnSample(&f);
+	if (r > 0)
+		return 1;
+
+	if (f->type == SATURN_FRAME_MOUSE)
+		g_mouse_detected = 1;
+
+#if WITH_READ_CHECK
+	if (r == 0 && f->type != SATURN_FRAME_NONE) {
+		g_telemetry.reads_checked++;
+		if (!frameConsistent(f)) {
+			g_telemetry.reads_rejected++;
+			r = -1;
+		}
+	}
+#endif
+
+	// An unknown ID while a controller was connected counts as a
+	// failed read too: the one that was there may just have answered
+	// badly once.
+	if (r == 0 && f->type == SATURN_FRAME_NONE && !g_disconnected)
+		r = -1;
+
+	// The last good report stays for HOLD_LAST_GOOD failed reads in a
+	// row. After that the controller is considered gone.
+	if (r) {
+		if (failed_reads < 255)
+			failed_reads++;
+		if (failed_reads <= HOLD_LAST_GOOD)
+			return r;
+		if (!g_disconnected)
+			g_telemetry.read_hold_expired++;
+		return disconnect();
+	}
+	failed_reads = 0;
+
+	switch (f->type)
+	{
+		case SATURN_FRAME_ANALOG:
+			g_disconnected = 0;
+			idleMouse();
+			g_digital_axes = saturnDecodeAnalog(f, new_report[JOYSTICK_REPORT_IDX]);
+			permuteButtons();
+			return 0;
+
+		case SATURN_FRAME_PAD:
+			g_disconnected = 0;
+			idleMouse();
+			g_digital_axes = 1;
+			saturnDecodePad(f, new_report[JOYSTICK_REPORT_IDX]);
+			permuteButtons();
+			return 0;
+
+		case SATURN_FRAME_MOUSE:
+			g_disconnected = 0;
+			g_digital_axes = 1;
+			idleJoystick();
+			decodeMouse(f);
+			return 0;
+	}
+
+	return disconnect();
+}
+
+static void saturnUpdate(void)
+{
+	char r;
+#if WITH_ANALOG_HYSTERESIS
+	char held;
+#endif
+
+#if WITH_SAMPLE_ISR
+	// Sampling runs in the timer interrupt, only new frames are decoded.
+	if (!fb_fresh)
+		return;
+#endif
+
+	if (g_raw) {
+		SaturnFrame *f;
+
+		// A failed capture keeps the previous frame
+		if (saturnSample(&f) == 0)
+			saturnFramePack(f, new_report[JOYSTICK_REPORT_IDX]);
+		checkReport(JOYSTICK_REPORT_IDX);
+		return;
+	}
+
+	r = saturnRead();
+	if (r > 0)
+		return;
+
+	if (r == 0 && !g_digital_axes) {
+#if WITH_ANALOG_CALIBRATION
+		// only on fresh data, calibrating twice would distort
+		analogcalApply(new_report[JOYSTICK_REPORT_IDX]);
+#endif
+#if WITH_ANALOG_FILTER
+		analogfilterApply(new_report[JOYSTICK_REPORT_IDX]);
+#endif
+	}
+#if WITH_ANALOG_FILTER
+	// start over from the next analog sample
+	if (g_digital_axes)
+		analogfilterReset();
+#endif
+
+#if WITH_PRESS_LATCH
+	latchPresses();
+#endif
+#if WITH_MOUSE_ACCUMULATOR
+	if (g_mouse_mode)
+		mouseFromAccumulator();
+#endif
+#if WITH_ANALOG_HYSTERESIS
+	held = 0;
+	if (!g_digital_axes && !g_compact)
+		held = analogHysteresis();
+#endif
+
+	// Reads which failed left new_report untouched
+	if (g_compact)
+		compactReport(compact_report, new_report[JOYSTICK_REPORT_IDX]);
+	if (!checkReport(JOYSTICK_REPORT_IDX)) {
+#if WITH_ANALOG_HYSTERESIS
+		if (held)
+			g_telemetry.analog_suppressed++;
+#endif
+	}
+	checkReport(MOUSE_REPORT_IDX);
+
+#if WITH_MOUSE_ACCUMULATOR
+	// Motion left over after the last report must go out even if the
+	// report bytes are the same.
+	if (mouse_acc[0] || mouse_acc[1])
+		report_dirty |= (1<<MOUSE_REPORT_IDX);
+#endif
+
+#if WITH_EVENT_QUEUE
+	// Joystick changes go through the queue instead of the dirty bit
+	if (report_dirty & (1<<JOYSTICK_REPORT_IDX)) {
+		report_dirty &= ~(1<<JOYSTICK_REPORT_IDX);
+		if (evqueuePush(finalReport(JOYSTICK_REPORT_IDX), timebaseNow()))
+			g_telemetry.evqueue_coalesced++;
+	}
+#endif
+}
+
+static unsigned char currentReportIdx(void)
 {
 	if (g_mouse_mode) {
-		report_id = MOUSE_REPORT_IDX;
-	} else {
-		report_id = JOYSTICK_REPORT_IDX;
+		return MOUSE_REPORT_IDX;
 	}
+	return JOYSTICK_REPORT_IDX;
+}
+
+/* GET_REPORT. With WITH_PRESS_LATCH, the latched presses are included
+ * but not cleared: only the interrupt report (saturnTakeReport()) does
+ * that, so a press read here is sent once more on the endpoint. */
+static char saturnBuildReport(unsigned char *reportBuffer, unsigned char report_id)
+{
+	report_id = currentReportIdx();
 
 	if (reportBuffer != NULL)
 	{
-		memcpy(reportBuffer, last_built_report[report_id], report_sizes[report_id]);
+		memcpy(reportBuffer, finalReport(report_id), report_sizes[report_id]);
 	}
-	memcpy(last_sent_report[report_id], last_built_report[report_id], 
-			report_sizes[report_id]);	
 
 	return report_sizes[report_id];
 }
 
-static char saturnChanged(unsigned char report_id)
+static char saturnTakeReport(unsigned char **report, unsigned char report_id)
 {
-	static int first = 1;
-	if (first) { first = 0;  return 1; }
+	report_id = currentReportIdx();
 
-	if (g_mouse_mode) {
-		report_id = MOUSE_REPORT_IDX;
-	} else {
-		report_id = JOYSTICK_REPORT_IDX;
+#if WITH_EVENT_QUEUE
+	if (report_id == JOYSTICK_REPORT_IDX && !evqueueEmpty()) {
+		tick_t queued, age;
+
+		*report = (unsigned char*)evqueueOldest(&queued);
+		evqueuePop();
+		sent_idx = report_id;
+
+		age = timebaseNow() - queued;
+		if (age > g_telemetry.evqueue_age_max)
+			g_telemetry.evqueue_age_max = age;
+
+		return report_sizes[report_id];
+	}
+#endif
+
+	*report = finalReport(report_id);
+	sent_idx = report_id;
+
+#if WITH_MOUSE_ACCUMULATOR
+	if (report_id == MOUSE_REPORT_IDX) {
+		if (report_dirty & (1<<report_id)) {
+			mouseReportSent(*report);
+		} else {
+			// Idle resend. The motion in there was delivered already.
+			mouseSetMotion(new_report[MOUSE_REPORT_IDX], 0, 0);
+		}
 	}
+#endif
+	report_dirty &= ~(1<<report_id);
+
+#if WITH_PRESS_LATCH
+	// The host has the latched presses now. Releases will show up in
+	// the next update.
+	clearLatches();
+#endif
+
+	return report_sizes[report_id];
+}
+
+static unsigned char saturnChanged(void)
+{
+#if WITH_EVENT_QUEUE
+	if (!g_mouse_mode && !evqueueEmpty())
+		return 0x01;
+#endif
 
-	return memcmp(last_built_report[report_id], last_sent_report[report_id], 
-					report_sizes[report_id]);
+	// Only one report is exposed (ID 1): the mouse or the joystick.
+	return (report_dirty & (1<<currentReportIdx())) ? 0x01 : 0;
 }
 
 
@@ -648,7 +1392,8 @@ static Gamepad saturnGamepad = {
 	init: 				saturnInit,
 	update: 			saturnUpdate,
 	changed:			saturnChanged,
-	buildReport:		saturnBuildReport
+	buildReport:		saturnBuildReport,
+	takeReport:			saturnTakeReport
 };
 
 Gamepad *saturnGetGamepad(void)
@@ -2,3 +2,7 @@
 
 Gamepad *saturnGetGamepad(void);
 
+/** WITH_ADAPTIVE_RATE: the sampling rate went to the idle rate (slow)
+ * or back. Empty probes are only spaced out at the full rate. */
+void saturnSetSlowRate(char slow);
+
@@ -0,0 +1,211 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <string.h>
+#include "saturn_decode.h"
+
+// Mouse status nibble (nib[2]): Y over, X over, Y sign, X sign
+#define MOUSE_X_SIGN	0x01
+#define MOUSE_Y_SIGN	0x02
+#define MOUSE_X_OVER	0x04
+#define MOUSE_Y_OVER	0x08
+
+void saturnIdleJoystick(unsigned char *joy_report)
+{
+	joy_report[0] = 0x7F;
+	joy_report[1] = 0x7F;
+	joy_report[2] = 0x7F;
+	joy_report[3] = 0x7F;
+	joy_report[4] = 0;
+	joy_report[5] = 0;
+}
+
+void saturnDecodePad(const SaturnFrame *f, unsigned char *joy_report)
+{
+	unsigned char d = f->nib[0];
+	unsigned char a = f->nib[1];
+	unsigned char b = f->nib[2];
+	unsigned char c = f->nib[3];
+
+	saturnIdleJoystick(joy_report);
+
+	if (!(c & 0x08)) // right
+		joy_report[0] = 0xff;
+	if (!(c & 0x04)) // left
+		joy_report[0] = 0x00;
+	if (!(c & 0x02)) // down
+		joy_report[1] = 0xff;
+	if (!(c & 0x01)) // Up
+		joy_report[1] = 0x00;
+
+	if (!(b & 0x04)) // A
+		joy_report[4] |= 0x01;
+	if (!(b & 0x01)) // B
+		joy_report[4] |= 0x02;
+	if (!(b & 0x02)) // C
+		joy_report[4] |= 0x04;
+
+	if (!(a & 0x04)) // X
+		joy_report[4] |= 0x08;
+	if (!(a & 0x02)) // Y
+		joy_report[4] |= 0x10;
+	if (!(a & 0x01)) // Z
+		joy_report[4] |= 0x20;
+
+	if (!(b & 0x08)) // Start
+		joy_report[4] |= 0x40;
+
+	if (!(d & 0x08)) // L
+		joy_report[4] |= 0x80;
+	if (!(a & 0x08)) // R
+		joy_report[5] |= 0x01;
+}
+
+char saturnDecodeAnalog(const SaturnFrame *f, unsigned char *joy_report)
+{
+	const unsigned char *dat = f->nib;
+	char digital_mode = (dat[1] & 0x0f) == 0x02;
+
+	saturnIdleJoystick(joy_report);
+	// dat[2]  : Up Dn Lf Rt
+	// dat[3]  : B  C  A  St
+	// dat[4]  : Z  Y  X  R
+	// dat[5]  : ?  ?  ?  L
+	
+	if (!(dat[3] & 0x04)) // A
+		joy_report[4] |= 0x01;
+	if (!(dat[3] & 0x01)) // B
+		joy_report[4] |= 0x02;
+	if (!(dat[3] & 0x02)) // C
+		joy_report[4] |= 0x04;
+
+	if (!(dat[4] & 0x04)) // X
+		joy_report[4] |= 0x08;
+	if (!(dat[4] & 0x02)) // Y
+		joy_report[4] |= 0x10;
+	if (!(dat[4] & 0x01)) // Z
+		joy_report[4] |= 0x20;
+
+	if (!(dat[3] & 0x08)) // Start
+		joy_report[4] |= 0x40;
+
+	if (!(dat[5] & 0x08)) // L
+		joy_report[4] |= 0x80;
+	if (!(dat[4] & 0x08)) // R
+		joy_report[5] |= 0x01;
+	
+	if (digital_mode) {
+		// switch is in the "+" position
+		if (!(dat[2] & 0x08)) // right
+			joy_report[0] = 0xff;
+		if (!(dat[2] & 0x04)) // left
+			joy_report[0] = 0x00;
+		if (!(dat[2] & 0x02)) // down
+			joy_report[1] = 0xff;
+		if (!(dat[2] & 0x01)) // Up
+			joy_report[1] = 0x00;
+	}
+	else {
+		if (!(dat[2] & 0x08)) // Right
+			joy_report[5] |= 0x04;
+		if (!(dat[2] & 0x04)) // Left
+			joy_report[5] |= 0x08;
+		if (!(dat[2] & 0x02)) // Down
+			joy_report[5] |= 0x10;
+		if (!(dat[2] & 0x01)) // Up
+			joy_report[5] |= 0x20;
+
+		// switch is in the "o" position
+		joy_report[0] = (dat[7] & 0xf) | (dat[6] << 4);
+		joy_report[1] = (dat[9] & 0xf) | (dat[8] << 4);
+		joy_report[2] = (dat[11] & 0xf) | (dat[10] << 4);
+		joy_report[3] = (dat[13] & 0xf) | (dat[12] << 4);
+	} 
+
+	return digital_mode;
+}
+
+/* The mouse sends a 9 bit signed delta (magnitude byte + sign bit).
+ * When the overflow bit is set the magnitude is unknown, use the
+ * largest value. */
+static int mouseAxis(unsigned char value, unsigned char sign, unsigned char over)
+{
+	if (over)
+		return sign ? -256 : 255;
+	return sign ? (int)value - 256 : value;
+}
+
+void saturnDecodeMouse(const SaturnFrame *f, unsigned char *buttons, int *dx, int *dy)
+{
+	const unsigned char *dat = f->nib;
+	unsigned char x, y;
+
+	*buttons = dat[3] & 0x0f;
+
+	x = (dat[5]&0xf) | (dat[4]<<4);
+	y = (dat[7]&0xf) | (dat[6]<<4);
+
+	// The mouse Y axis points up, USB mice down.
+	*dx = mouseAxis(x, dat[2] & MOUSE_X_SIGN, dat[2] & MOUSE_X_OVER);
+	*dy = -mouseAxis(y, dat[2] & MOUSE_Y_SIGN, dat[2] & MOUSE_Y_OVER);
+}
+
+char saturnFrameIdValid(const SaturnFrame *f)
+{
+	unsigned char id = (f->nib[0] << 4) | (f->nib[1] & 0x0f);
+
+	switch (f->type)
+	{
+		case SATURN_FRAME_PAD:
+			return (f->nib[0] & 0x17) == 0x14;
+		case SATURN_FRAME_ANALOG:
+			// analog or digital mode
+			return id == 0x16 || id == 0x02;
+		case SATURN_FRAME_MOUSE:
+			return id == 0xE3;
+	}
+
+	return 0;
+}
+
+void saturnFramePack(const SaturnFrame *f, unsigned char *raw)
+{
+	unsigned char i;
+
+	raw[0] = f->type;
+	for (i=0; i<SATURN_FRAME_NIBBLES/2; i++) {
+		raw[1+i] = (f->nib[i*2] << 4) | (f->nib[i*2+1] & 0x0f);
+	}
+}
+
+char saturnFrameUnpack(const unsigned char *raw, SaturnFrame *f)
+{
+	unsigned char i;
+
+	if (raw[0] > SATURN_FRAME_MOUSE)
+		return -1;
+
+	f->type = raw[0];
+	for (i=0; i<SATURN_FRAME_NIBBLES/2; i++) {
+		f->nib[i*2] = raw[1+i] >> 4;
+		f->nib[i*2+1] = raw[1+i] & 0x0f;
+	}
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef _saturn_decode_h__
+#define _saturn_decode_h__
+
+/* Frames captured from the controller, and the decoders turning them
+ * into joystick and mouse reports. The firmware captures and decodes,
+ * or sends frames as is in raw mode (saturnFramePack) for the host
+ * library in host/ to decode with this same code.
+ *
+ * No AVR dependencies. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SATURN_FRAME_NONE		0 // nothing connected or unknown
+#define SATURN_FRAME_PAD		1 // 4 nibbles: ID (1L100), Z Y X R, B C A St, Up Dn Lt Rt
+#define SATURN_FRAME_ANALOG		2 // 3D pad, 14 nibbles (8 in digital mode)
+#define SATURN_FRAME_MOUSE		3 // Shuttle Mouse, 8 nibbles
+
+#define SATURN_FRAME_NIBBLES	14
+
+typedef struct {
+	unsigned char type;
+	unsigned char nib[SATURN_FRAME_NIBBLES]; // data in bits 0-3, bit 4 is TL
+} SaturnFrame;
+
+/* Joystick report: X, Y, Rx, Rz (0-255, 0x7F at rest), buttons 0-7,
+ * buttons 8-15. Buttons are in controller order, before remapping. */
+#define SATURN_JOY_REPORT_SIZE	6
+
+/* Raw report: frame type, then the 14 nibbles, 2 per byte, first one
+ * in the high half. */
+#define SATURN_RAW_REPORT_SIZE	8
+
+void saturnIdleJoystick(unsigned char *joy_report);
+
+void saturnDecodePad(const SaturnFrame *f, unsigned char *joy_report);
+
+/** \return 1 if the 3D pad is in digital mode (X/Y from the D-Pad, no
+ * Rx/Rz), 0 in analog mode. */
+char saturnDecodeAnalog(const SaturnFrame *f, unsigned char *joy_report);
+
+/** Buttons as in the mouse report (bit 0: left). Motion in USB
+ * direction (Y down): dx from -256 to 255, dy from -255 to 256 since
+ * Y is inverted. */
+void saturnDecodeMouse(const SaturnFrame *f, unsigned char *buttons, int *dx, int *dy);
+
+/** Check the ID found in the frame data against the frame type: the
+ * first pad nibble, or the ID byte (type, data length) the 3D pad and
+ * the mouse send first.
+ * \return 1 if it matches */
+char saturnFrameIdValid(const SaturnFrame *f);
+
+void saturnFramePack(const SaturnFrame *f, unsigned char *raw);
+
+/** \return 0, or -1 if the frame type is unknown */
+char saturnFrameUnpack(const unsigned char *raw, SaturnFrame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _saturn_decode_h__
@@ -0,0 +1,99 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include "config.h"
+#include "tasks.h"
+#include "telemetry.h"
+
+static Task *task_table;
+static unsigned char num_tasks;
+static Task *current;
+
+void tasksInit(Task *tasks, unsigned char count)
+{
+	unsigned char i;
+	tick_t now = timebaseNow();
+
+	task_table = tasks;
+	num_tasks = count;
+	g_telemetry.num_tasks = count;
+
+	for (i=0; i<count; i++) {
+		tasks[i].due = now;
+	}
+}
+
+void tasksRun(void)
+{
+	unsigned char i;
+	tick_t now, late;
+	Task *t;
+
+	for (i=0; i<num_tasks; i++) {
+		t = &task_table[i];
+		now = timebaseNow();
+		late = now - t->due;
+
+		// not due yet (the difference wrapped)
+		if (late & 0x8000)
+			continue;
+
+		if (late > g_telemetry.task_late_max[i])
+			g_telemetry.task_late_max[i] = late;
+		if (t->deadline && late > t->deadline)
+			g_telemetry.task_overruns[i]++;
+
+		if (t->period) {
+			t->due += t->period;
+			// Missed whole periods are skipped, not run back to back.
+			if (!((tick_t)(now - t->due) & 0x8000))
+				t->due = now + t->period;
+		} else {
+			t->due = now;
+		}
+
+		current = t;
+		t->run();
+	}
+}
+
+void tasksSetPeriod(tick_t period)
+{
+	current->period = period;
+	current->due = timebaseNow() + period;
+}
+
+char tasksNextDue(tick_t *due)
+{
+	unsigned char i;
+	char found = 0;
+	tick_t now = timebaseNow();
+
+	for (i=0; i<num_tasks; i++) {
+		if (!task_table[i].period)
+			continue;
+		// compare relative to now, the counter wraps
+		if (!found || (tick_t)(task_table[i].due - now) < (tick_t)(*due - now)) {
+			*due = task_table[i].due;
+			found = 1;
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,39 @@
+#ifndef _tasks_h__
+#define _tasks_h__
+
+#include "timebase.h"
+
+/* Cooperative scheduler for the main loop. Each pass runs every task
+ * that is due, in table order. A task with a period runs once per
+ * period (on a fixed grid, without drift). A task without one runs on
+ * every pass.
+ *
+ * Lateness is the time from when a task was due to when it started.
+ * For tasks without a period, that is the time since their previous
+ * start. Lateness above the task deadline is an overrun. The worst
+ * lateness and the overrun count of each task are kept in telemetry,
+ * so a slow new feature shows up there instead of silently delaying
+ * usbPoll() or the reports. */
+
+typedef struct {
+	void (*run)(void);
+	tick_t period;		// 0: every pass
+	tick_t deadline;	// largest acceptable lateness, 0: no limit
+	tick_t due;
+} Task;
+
+/** The table must stay valid, at most MAX_TASKS entries. */
+void tasksInit(Task *tasks, unsigned char count);
+
+/** One pass over the table */
+void tasksRun(void);
+
+/** From within a task, change its own period. The next run is one
+ * new period from now. */
+void tasksSetPeriod(tick_t period);
+
+/** Earliest due time of the periodic tasks. Returns 0 when there
+ * are none, as the others run on every pass. */
+char tasksNextDue(tick_t *due);
+
+#endif // _tasks_h__
@@ -0,0 +1,111 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "usbdrv.h"
+#include "telemetry.h"
+#include "timebase.h"
+
+Telemetry g_telemetry;
+
+/* Copy sent to the host, shared by the control read and the stream.
+ * Both span several usbPoll() calls while the counters keep changing,
+ * a copy keeps multi-byte counters across packet boundaries whole. */
+static Telemetry snapshot;
+static unsigned char read_offset = sizeof(Telemetry);
+
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+static unsigned char stream_offset = sizeof(Telemetry);
+static tick_t stream_started, read_started;
+#endif
+
+void telemetryClear(void)
+{
+	unsigned char num_reports = g_telemetry.num_reports;
+	unsigned char num_tasks = g_telemetry.num_tasks;
+
+	memset(&g_telemetry, 0, sizeof(g_telemetry));
+	g_telemetry.version = TELEMETRY_VERSION;
+	g_telemetry.size = sizeof(g_telemetry);
+	g_telemetry.cpu_khz = F_CPU / 1000L;
+	g_telemetry.num_reports = num_reports;
+	g_telemetry.num_tasks = num_tasks;
+}
+
+void telemetryReadStart(void)
+{
+	snapshot = g_telemetry;
+	read_offset = 0;
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+	read_started = timebaseNow();
+	// A pass in progress was sent from the previous copy, start over
+	if (stream_offset < sizeof(Telemetry))
+		stream_offset = 0;
+#endif
+}
+
+unsigned char telemetryRead(unsigned char *data, unsigned char len)
+{
+	if (len > sizeof(Telemetry) - read_offset)
+		len = sizeof(Telemetry) - read_offset;
+
+	memcpy(data, (unsigned char*)&snapshot + read_offset, len);
+	read_offset += len;
+
+	return len;
+}
+
+#if USB_CFG_HAVE_INTRIN_ENDPOINT3
+void telemetryStream(void)
+{
+	unsigned char packet[8];
+	unsigned char len;
+
+	if (stream_offset >= sizeof(Telemetry)) {
+		if ((tick_t)(timebaseNow() - stream_started) < TIMEBASE_MS_TO_TICKS(TELEMETRY_STREAM_INTERVAL_MS))
+			return;
+		stream_started = timebaseNow();
+		stream_offset = 0;
+
+		// Keep the copy a control read is still being sent from. The
+		// host may also have asked for less than the whole structure,
+		// so after an interval the read is considered over.
+		if (read_offset >= sizeof(Telemetry) ||
+				(tick_t)(stream_started - read_started) >= TIMEBASE_MS_TO_TICKS(TELEMETRY_STREAM_INTERVAL_MS))
+			snapshot = g_telemetry;
+	}
+
+	len = sizeof(Telemetry) - stream_offset;
+	if (len > 7)
+		len = 7;
+
+	packet[0] = stream_offset;
+	memcpy(packet + 1, (unsigned char*)&snapshot + stream_offset, len);
+	usbSetInterrupt3(packet, len + 1);
+
+	stream_offset += len;
+}
+#endif
+
+void telemetryInit(unsigned char num_reports)
+{
+	g_telemetry.num_reports = num_reports;
+	telemetryClear();
+}
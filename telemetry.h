@@ -0,0 +1,77 @@
+#ifndef _telemetry_h__
+#define _telemetry_h__
+
+#include "config.h"
+
+#define TELEMETRY_VERSION		6
+
+/* Counters readable by the host. Multi-byte values are little endian,
+ * durations are in timebase ticks (TIMEBASE_PRESCALER / (cpu_khz * 1000)
+ * seconds each). Only updated from the main loop, never from interrupts,
+ * so a copy taken in the main loop is consistent. */
+typedef struct {
+	unsigned char version;
+	unsigned char size;
+	unsigned int cpu_khz;
+	unsigned char num_reports;
+
+	unsigned int reports_sent[MAX_REPORTS];
+	unsigned int latency_last[MAX_REPORTS]; // change detected -> collected by host
+	unsigned int latency_max[MAX_REPORTS];
+	unsigned int stale_resends;
+
+	unsigned int crc_cache_hits;
+	unsigned int crc_cache_misses;
+
+	// WITH_EVENT_QUEUE
+	unsigned int evqueue_coalesced;
+	unsigned int evqueue_age_max; // time from queuing to transmission
+
+	// WITH_ANALOG_HYSTERESIS: polls where only sub-threshold analog
+	// changes occurred.
+	unsigned int analog_suppressed;
+	// main loop tasks, in table order (see main.c)
+	unsigned char num_tasks;
+	unsigned int task_overruns[MAX_TASKS]; // started later than their deadline
+	unsigned int task_late_max[MAX_TASKS];
+
+	// WITH_ADAPTIVE_RATE: switches to each rate and time spent in them
+	unsigned int rate_bursts; // idle -> full rate
+	unsigned int rate_idles; // full rate -> idle
+	unsigned long rate_fast_time;
+	unsigned long rate_slow_time;
+
+	// WITH_READ_CHECK
+	unsigned long reads_checked;
+	unsigned int reads_rejected;
+
+	// handshake timeouts, retries after them, and holds of the last
+	// good report that ran out (see HOLD_LAST_GOOD)
+	unsigned int read_timeouts;
+	unsigned int read_retries;
+	unsigned int read_hold_expired;
+} Telemetry;
+
+extern Telemetry g_telemetry;
+
+void telemetryInit(unsigned char num_reports);
+void telemetryClear(void);
+
+/** Start a control read of g_telemetry (return 0xff from
+ * usbFunctionSetup() after this). Takes the copy the read is sent
+ * from. */
+void telemetryReadStart(void);
+
+/** Copy the next part of a control read, for usbFunctionRead(). All
+ * packets come from the copy taken by telemetryReadStart(). */
+unsigned char telemetryRead(unsigned char *data, unsigned char len);
+
+/** Send the next telemetry packet on endpoint 3. Call when
+ * usbInterruptIsReady3() is true. The packets of one pass all come
+ * from a copy taken when the pass starts, or from the one a control
+ * read is being sent from. A control read restarts the pass.
+ *
+ * Packet format: [0] offset in the Telemetry structure, [1-7] data */
+void telemetryStream(void);
+
+#endif // _telemetry_h__
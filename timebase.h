@@ -0,0 +1,57 @@
+#ifndef _timebase_h__
+#define _timebase_h__
+
+#include <avr/io.h>
+
+/* Timer1 runs freely with a 1024 prescaler (85.3us per tick at 12 MHz)
+ * and serves as the common time reference. The 16 bit counter wraps
+ * after about 5.5 seconds at 12 MHz (3.3 seconds at 20 MHz), so only
+ * differences between readings taken less than that apart are meaningful. */
+#define TIMEBASE_PRESCALER			1024
+
+#define TIMEBASE_MS_TO_TICKS(ms)	((unsigned int)(((F_CPU/1000L) * (ms)) / TIMEBASE_PRESCALER))
+#define TIMEBASE_HZ_TO_TICKS(hz)	((unsigned int)((F_CPU / TIMEBASE_PRESCALER) / (hz)))
+#define TIMEBASE_US_TO_TICKS(us)	((unsigned int)(((F_CPU/1000000L) * (us)) / TIMEBASE_PRESCALER))
+
+typedef unsigned int tick_t;
+
+static inline void timebaseInit(void)
+{
+	TCCR1A = 0;
+	TCCR1B = (1<<CS12)|(1<<CS10);
+}
+
+static inline tick_t timebaseNow(void)
+{
+	return TCNT1;
+}
+
+/* Timer1 compare A interrupt at the given time, to wake the CPU
+ * from sleep. The interrupt itself does nothing. */
+#if defined(TIMSK1)
+static inline void timebaseWakeAt(tick_t t)
+{
+	OCR1A = t;
+	TIFR1 = 1<<OCF1A;
+	TIMSK1 |= 1<<OCIE1A;
+}
+
+static inline void timebaseWakeCancel(void)
+{
+	TIMSK1 &= ~(1<<OCIE1A);
+}
+#else
+static inline void timebaseWakeAt(tick_t t)
+{
+	OCR1A = t;
+	TIFR = 1<<OCF1A;
+	TIMSK |= 1<<OCIE1A;
+}
+
+static inline void timebaseWakeCancel(void)
+{
+	TIMSK &= ~(1<<OCIE1A);
+}
+#endif
+
+#endif // _timebase_h__
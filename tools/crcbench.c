@@ -0,0 +1,407 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Cycle counts of the interrupt report CRC, measured on the built ELF in
+ * simavr:
+ *  - usbCrc16() from usbdrvasm.S, which usbSetInterrupt() runs on every
+ *    report
+ *  - crcNibble(), a table-driven nibble variant (only built with
+ *    WITH_CRC_BENCHMARK)
+ *  - crccacheSetInterrupt() on a cache miss and on a cache hit, best and
+ *    worst case
+ *
+ * Build: make crcbench (needs simavr and libelf)
+ * Usage: crcbench [-m mcu] [-f hz] [-l length] [-n payloads] firmware.elf
+ *
+ *   make crcbench                       (main.bin, ATmega8)
+ *   make -f Makefile.atmega168 crcbench (saturn_usb.m168.elf)
+ *
+ * The firmware runs from reset until it enters main(), so .data and
+ * .bss are set up and interrupts are still disabled. Each function is
+ * then called directly: arguments in r24/r25 and r22, a return address
+ * pointing at main() on the stack. The count goes from the first
+ * instruction to the return, the caller's call instruction excluded.
+ * Results are checked against a CRC computed here.
+ *
+ * The cycle counts do not depend on the clock, which only scales the
+ * times in microseconds. usbCrc16() is the same code for all the
+ * usbdrvasm12/15/16/165 modules.
+ *
+ * Worst cases of the cache: all entries in use and differing from the
+ * payload in its last byte only, so each comparison runs to the end. The
+ * worst hit is in the last entry searched.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <gelf.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+
+#define DATA_OFFSET			0x800000	// data addresses in AVR ELF files
+#define CALL_CYCLES_MAX		100000
+#define MAX_PAYLOAD			8
+#define CACHE_ENTRY_SIZE	11			// crc_cache_entry in crccache.c
+
+/* ------------------------------------------------------------------------- */
+/* Symbols                                                                   */
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+	const char *name;
+	long addr;		// -1: not in this build
+	long size;
+} Symbol;
+
+static Symbol sym_main = { "main" };
+static Symbol sym_crc16 = { "usbCrc16" };
+static Symbol sym_nibble = { "crcNibble" };
+static Symbol sym_cache_init = { "crccacheInit" };
+static Symbol sym_cache_send = { "crccacheSetInterrupt" };
+static Symbol sym_cache = { "crc_cache" };
+static Symbol sym_tx_buf = { "usbTxBuf1" };
+
+static Symbol *symbols[] = {
+	&sym_main, &sym_crc16, &sym_nibble, &sym_cache_init, &sym_cache_send,
+	&sym_cache, &sym_tx_buf,
+};
+#define NUM_SYMBOLS	(sizeof(symbols) / sizeof(symbols[0]))
+
+static int loadSymbols(const char *path)
+{
+	Elf *e;
+	Elf_Scn *scn = NULL;
+	Elf_Data *data;
+	GElf_Shdr shdr;
+	GElf_Sym sym;
+	const char *name;
+	size_t i, j, n;
+	int fd, type;
+
+	for (j=0; j<NUM_SYMBOLS; j++)
+		symbols[j]->addr = -1;
+
+	if (elf_version(EV_CURRENT) == EV_NONE)
+		return -1;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	e = elf_begin(fd, ELF_C_READ, NULL);
+	if (!e) {
+		fprintf(stderr, "%s: %s\n", path, elf_errmsg(-1));
+		close(fd);
+		return -1;
+	}
+
+	while ((scn = elf_nextscn(e, scn)) != NULL) {
+		if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_SYMTAB)
+			continue;
+		data = elf_getdata(scn, NULL);
+		n = shdr.sh_size / shdr.sh_entsize;
+
+		for (i=0; i<n; i++) {
+			if (!gelf_getsym(data, i, &sym))
+				continue;
+			name = elf_strptr(e, shdr.sh_link, sym.st_name);
+			if (!name)
+				continue;
+			type = GELF_ST_TYPE(sym.st_info);
+
+			for (j=0; j<NUM_SYMBOLS; j++) {
+				if (strcmp(name, symbols[j]->name))
+					continue;
+				// usbCrc16 is an assembler label without a type
+				if (type == STT_OBJECT)
+					symbols[j]->addr = sym.st_value - DATA_OFFSET;
+				else
+					symbols[j]->addr = sym.st_value;
+				symbols[j]->size = sym.st_size;
+			}
+		}
+	}
+
+	elf_end(e);
+	close(fd);
+
+	if (sym_main.addr < 0 || sym_crc16.addr < 0) {
+		fprintf(stderr, "%s: no main or usbCrc16 symbol\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Calls                                                                     */
+/* ------------------------------------------------------------------------- */
+
+static avr_t *avr;
+static uint16_t payload_addr;	// in SRAM, below the initial stack
+
+/* Run from reset to the entry of main() */
+static int boot(elf_firmware_t *fw)
+{
+	avr = avr_make_mcu_by_name(fw->mmcu);
+	if (!avr) {
+		fprintf(stderr, "unknown mcu %s\n", fw->mmcu);
+		return -1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, fw);
+
+	while ((long)avr->pc != sym_main.addr) {
+		if (avr->cycle > CALL_CYCLES_MAX || avr_run(avr) >= cpu_Done) {
+			fprintf(stderr, "main() not reached\n");
+			return -1;
+		}
+	}
+
+	payload_addr = avr->ramend - 15;
+	return 0;
+}
+
+/* Call func(payload, len) with the payload copied to SRAM.
+ * \return the cycles taken, 0 on failure. *result gets r24/r25. */
+static avr_cycle_count_t call(long func, const unsigned char *payload, unsigned char len, unsigned int *result)
+{
+	uint16_t sp = payload_addr - 1;
+	uint16_t ret = sym_main.addr / 2; // word address
+	avr_cycle_count_t start;
+
+	memcpy(avr->data + payload_addr, payload, len);
+
+	// as pushed by call: low byte first, the stack grows down
+	avr->data[sp--] = ret & 0xff;
+	avr->data[sp--] = ret >> 8;
+	avr->data[R_SPL] = sp & 0xff;
+	avr->data[R_SPH] = sp >> 8;
+
+	avr->data[24] = payload_addr & 0xff;
+	avr->data[25] = payload_addr >> 8;
+	avr->data[22] = len;
+	avr->data[23] = 0;
+	avr->data[1] = 0; // gcc's zero register
+
+	avr->pc = func;
+	start = avr->cycle;
+	while ((long)avr->pc != sym_main.addr) {
+		if (avr->cycle - start > CALL_CYCLES_MAX || avr_run(avr) >= cpu_Done) {
+			fprintf(stderr, "call to 0x%04lx did not return\n", func);
+			return 0;
+		}
+	}
+
+	if (result)
+		*result = avr->data[24] | (avr->data[25] << 8);
+	return avr->cycle - start;
+}
+
+static unsigned int crc16(const unsigned char *data, unsigned char len)
+{
+	unsigned int crc = 0xffff;
+	unsigned char i;
+
+	while (len--) {
+		crc ^= *data++;
+		for (i=0; i<8; i++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+	}
+	return ~crc & 0xffff;
+}
+
+/* CRC appended by crccacheSetInterrupt() (after the PID byte) */
+static unsigned int sentCrc(unsigned char len)
+{
+	const unsigned char *p = avr->data + sym_tx_buf.addr + 1 + len;
+
+	return p[0] | (p[1] << 8);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Results                                                                   */
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+	const char *name;
+	avr_cycle_count_t min, max, total;
+	unsigned long runs;
+	int failed;
+} Stat;
+
+static void add(Stat *s, avr_cycle_count_t c, int ok)
+{
+	if (!c || !ok) {
+		s->failed = 1;
+		return;
+	}
+	if (!s->runs || c < s->min)
+		s->min = c;
+	if (c > s->max)
+		s->max = c;
+	s->total += c;
+	s->runs++;
+}
+
+static void print(const Stat *s, uint32_t freq)
+{
+	if (s->failed) {
+		printf("  %-28s %s\n", s->name, "FAILED (wrong CRC or no return)");
+		return;
+	}
+	if (!s->runs) {
+		printf("  %-28s %s\n", s->name, "not in this build");
+		return;
+	}
+	printf("  %-28s %8llu %8.1f %8llu %8.1f\n", s->name,
+			(unsigned long long)s->min, (double)s->total / s->runs,
+			(unsigned long long)s->max, s->max * 1000000.0 / freq);
+}
+
+enum { ST_CRC16, ST_NIBBLE, ST_MISS_EMPTY, ST_MISS_FULL, ST_HIT_FIRST, ST_HIT_LAST, NUM_STATS };
+
+static Stat stats[NUM_STATS] = {
+	{ "usbCrc16" },
+	{ "crcNibble" },
+	{ "cache miss, empty cache" },
+	{ "cache miss, full cache" },
+	{ "cache hit, first entry" },
+	{ "cache hit, last entry" },
+};
+
+/* One payload through every path */
+static void measure(unsigned char *payload, unsigned char len, int entries)
+{
+	unsigned char other[MAX_PAYLOAD];
+	unsigned int r, expect = crc16(payload, len);
+	avr_cycle_count_t c;
+	int i;
+
+	c = call(sym_crc16.addr, payload, len, &r);
+	add(&stats[ST_CRC16], c, r == expect);
+
+	if (sym_nibble.addr >= 0) {
+		c = call(sym_nibble.addr, payload, len, &r);
+		add(&stats[ST_NIBBLE], c, r == expect);
+	}
+
+	if (!entries)
+		return;
+
+	// payload in the first entry searched
+	call(sym_cache_init.addr, payload, len, NULL);
+	c = call(sym_cache_send.addr, payload, len, NULL);
+	add(&stats[ST_MISS_EMPTY], c, sentCrc(len) == expect);
+	c = call(sym_cache_send.addr, payload, len, NULL);
+	add(&stats[ST_HIT_FIRST], c, sentCrc(len) == expect);
+
+	// entries 0 to n-2 differ in the last byte, the payload goes last
+	memcpy(other, payload, len);
+	call(sym_cache_init.addr, payload, len, NULL);
+	for (i=0; i<entries-1; i++) {
+		other[len-1] = payload[len-1] + 1 + i;
+		call(sym_cache_send.addr, other, len, NULL);
+	}
+	call(sym_cache_send.addr, payload, len, NULL);
+	c = call(sym_cache_send.addr, payload, len, NULL);
+	add(&stats[ST_HIT_LAST], c, sentCrc(len) == expect);
+
+	// all entries in use, none matching
+	other[len-1] = payload[len-1] + entries;
+	c = call(sym_cache_send.addr, other, len, NULL);
+	add(&stats[ST_MISS_FULL], c, sentCrc(len) == crc16(other, len));
+}
+
+int main(int argc, char **argv)
+{
+	elf_firmware_t fw;
+	const char *mcu = NULL;
+	uint32_t freq = 0;
+	unsigned char payload[MAX_PAYLOAD];
+	unsigned int len = 6;
+	unsigned long runs = 1000, n;
+	int entries = 0, opt, failed = 0;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "m:f:l:n:")) != -1) {
+		switch (opt)
+		{
+			case 'm': mcu = optarg; break;
+			case 'f': freq = strtoul(optarg, NULL, 0); break;
+			case 'l': len = strtoul(optarg, NULL, 0); break;
+			case 'n': runs = strtoul(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "Usage: crcbench [-m mcu] [-f hz] [-l length] [-n payloads] firmware.elf\n");
+				return 2;
+		}
+	}
+	if (optind >= argc || len < 1 || len > MAX_PAYLOAD) {
+		fprintf(stderr, "Usage: crcbench [-m mcu] [-f hz] [-l length] [-n payloads] firmware.elf\n");
+		return 2;
+	}
+
+	if (loadSymbols(argv[optind]))
+		return 2;
+	if (sym_cache.addr >= 0 && sym_cache_init.addr >= 0 &&
+			sym_cache_send.addr >= 0 && sym_tx_buf.addr >= 0)
+		entries = sym_cache.size / CACHE_ENTRY_SIZE;
+
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[optind], &fw)) {
+		fprintf(stderr, "%s: cannot load\n", argv[optind]);
+		return 2;
+	}
+	if (mcu)
+		snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", mcu);
+	else if (!fw.mmcu[0])
+		strcpy(fw.mmcu, "atmega8");
+	if (freq)
+		fw.frequency = freq;
+	else if (!fw.frequency)
+		fw.frequency = 12000000;
+
+	if (boot(&fw))
+		return 2;
+
+	// The idle joystick report first, then random ones
+	memset(payload, 0, sizeof(payload));
+	memset(payload, 0x7f, 4);
+	srand(1);
+	for (n=0; n<runs; n++) {
+		measure(payload, len, entries);
+		for (i=0; i<len; i++)
+			payload[i] = rand();
+	}
+	avr_terminate(avr);
+
+	printf("%s, %s at %u Hz, %u byte payloads, %lu runs, %d cache entries\n\n",
+			argv[optind], fw.mmcu, (unsigned)fw.frequency, len, runs, entries);
+	printf("  %-28s %8s %8s %8s %8s\n", "cycles", "min", "avg", "max", "max us");
+	for (i=0; i<NUM_STATS; i++) {
+		print(&stats[i], fw.frequency);
+		failed |= stats[i].failed;
+	}
+
+	return failed;
+}
@@ -0,0 +1,239 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Host-side simulation of the event queue (WITH_EVENT_QUEUE).
+ *
+ * A scripted, fast input sequence is sampled at the firmware sampling
+ * rate and delivered to a host polling the interrupt endpoint. Button
+ * transitions seen by the host are compared with those in the script,
+ * with and without the queue. A transition merged into another state
+ * when the queue is full never reaches the host as its own report, so
+ * it counts as dropped.
+ *
+ * Usage: evqsim [poll interval ms] [sampling rate Hz]
+ * The queue length is set at build time (make EVQUEUE_LENGTH=n).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../evqueue.h"
+
+#define MAX_EVENTS	256
+
+typedef struct {
+	long time_us;
+	unsigned int buttons; // state from this time on
+} script_event;
+
+static script_event script[MAX_EVENTS];
+static int script_len;
+static long script_end;
+
+static void scriptAdd(long time_us, unsigned int buttons)
+{
+	script[script_len].time_us = time_us;
+	script[script_len].buttons = buttons;
+	script_len++;
+}
+
+/* Fast but humanly possible input: bursts of mashing, plinking and
+ * rolling motions faster than a 10ms host poll, with short pauses
+ * between bursts. */
+static void buildScript(void)
+{
+	long t = 0;
+	int i;
+
+	scriptAdd(t, 0);
+	t += 20000;
+
+	// 10 bursts of 3 taps of button 1, 3ms down, 3ms up
+	for (i=0; i<30; i++) {
+		scriptAdd(t, 0x0001); t += 3000;
+		scriptAdd(t, 0x0000); t += 3000;
+		if (i % 3 == 2)
+			t += 80000;
+	}
+
+	// plinking: buttons 1, 2, 3 pressed 3ms apart, released together
+	for (i=0; i<10; i++) {
+		scriptAdd(t, 0x0001); t += 3000;
+		scriptAdd(t, 0x0003); t += 3000;
+		scriptAdd(t, 0x0007); t += 3000;
+		scriptAdd(t, 0x0000); t += 60000;
+	}
+	t += 20000;
+
+	// quarter circle forward + punch on the D-pad bits (down, down-right,
+	// right, right+button 4), 5ms per step
+	for (i=0; i<10; i++) {
+		scriptAdd(t, 0x1000); t += 5000;
+		scriptAdd(t, 0x1400); t += 5000;
+		scriptAdd(t, 0x0400); t += 5000;
+		scriptAdd(t, 0x0408); t += 5000;
+		scriptAdd(t, 0x0000); t += 80000;
+	}
+
+	script_end = t + 50000;
+}
+
+static unsigned int stateAt(long time_us)
+{
+	unsigned int s = 0;
+	int i;
+
+	for (i=0; i<script_len && script[i].time_us <= time_us; i++)
+		s = script[i].buttons;
+
+	return s;
+}
+
+static int countEdges(unsigned int a, unsigned int b)
+{
+	return __builtin_popcount(a ^ b);
+}
+
+static int scriptEdges(void)
+{
+	int i, n = 0;
+
+	for (i=1; i<script_len; i++)
+		n += countEdges(script[i-1].buttons, script[i].buttons);
+
+	return n;
+}
+
+static void toState(unsigned char *st, unsigned int buttons)
+{
+	memset(st, 0, EVQUEUE_STATE_SIZE);
+	st[4] = buttons;
+	st[5] = buttons >> 8;
+}
+
+static unsigned int fromState(const unsigned char *st)
+{
+	return st[4] | (st[5] << 8);
+}
+
+typedef struct {
+	int sampled_edges;	// transitions visible in the samples
+	int host_edges;		// transitions in the reports the host got
+	int reports;
+	int coalesced;
+	int merged_edges;	// transitions lost to coalescing
+	long max_delay_us;	// sample to delivery, queue only
+} sim_result;
+
+static const unsigned char buttons_mask[EVQUEUE_STATE_SIZE] = { 0, 0, 0, 0, 0xff, 0xff };
+
+static void simulate(int use_queue, long poll_us, long sample_us, sim_result *res)
+{
+	long t, next_poll = poll_us, next_sample = 0;
+	unsigned int sampled = 0, built = 0, sent = 0;
+	unsigned int newest = 0; // newest state in the queue
+	unsigned char st[EVQUEUE_STATE_SIZE];
+	int dirty = 0;
+
+	memset(res, 0, sizeof(*res));
+	evqueueInit(buttons_mask);
+
+	for (t=0; t<script_end; t++) {
+		if (t == next_sample) {
+			next_sample += sample_us;
+
+			sampled = stateAt(t);
+			res->sampled_edges += countEdges(built, sampled);
+			if (sampled != built) {
+				built = sampled;
+				if (use_queue) {
+					toState(st, built);
+					if (evqueuePush(st, t)) {
+						res->coalesced++;
+						res->merged_edges += countEdges(newest, built);
+						newest |= built;
+					} else {
+						newest = built;
+					}
+				} else {
+					dirty = 1;
+				}
+			}
+		}
+
+		if (t == next_poll) {
+			next_poll += poll_us;
+
+			if (use_queue) {
+				unsigned int queued;
+				const unsigned char *q = evqueueOldest(&queued);
+				if (q) {
+					unsigned int s = fromState(q);
+					long delay = t - queued;
+
+					if (delay > res->max_delay_us)
+						res->max_delay_us = delay;
+					evqueuePop();
+					res->host_edges += countEdges(sent, s);
+					sent = s;
+					res->reports++;
+				}
+			} else if (dirty) {
+				dirty = 0;
+				res->host_edges += countEdges(sent, built);
+				sent = built;
+				res->reports++;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long poll_ms = 10, sample_hz = 500;
+	sim_result plain, queued;
+	int edges;
+
+	if (argc > 1)
+		poll_ms = atol(argv[1]);
+	if (argc > 2)
+		sample_hz = atol(argv[2]);
+
+	buildScript();
+	edges = scriptEdges();
+
+	simulate(0, poll_ms * 1000, 1000000 / sample_hz, &plain);
+	simulate(1, poll_ms * 1000, 1000000 / sample_hz, &queued);
+
+	printf("host poll %ld ms, sampling %ld Hz, queue length %d\n",
+			poll_ms, sample_hz, EVQUEUE_LENGTH);
+	printf("script transitions: %d\n\n", edges);
+	printf("%-12s %8s %8s %8s %8s %10s\n", "mode", "sampled", "to host", "dropped", "reports", "coalesced");
+	printf("%-12s %8d %8d %8d %8d %10s\n", "no queue",
+			plain.sampled_edges, plain.host_edges,
+			edges - plain.host_edges, plain.reports, "-");
+	printf("%-12s %8d %8d %8d %8d %10d\n", "queue",
+			queued.sampled_edges, queued.host_edges,
+			edges - queued.sampled_edges + queued.merged_edges,
+			queued.reports, queued.coalesced);
+	printf("\nqueue: max delay from sample to host %ld us\n", queued.max_delay_us);
+
+	return 0;
+}
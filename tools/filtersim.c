@@ -0,0 +1,167 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Host-side measurement of the analog filters (WITH_ANALOG_FILTER).
+ *
+ * For each filter mode, a step from 0x80 to 0xff is fed one sample at
+ * a time and the samples needed for the output to first move, reach
+ * 50% and 90% of the step and settle within 1 LSB are counted. Then a
+ * resting stick with noise (+/- 2 LSB and a spike now and then) is fed
+ * and the output deviation and number of output changes are reported.
+ *
+ * Usage: filtersim [sampling rate Hz]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../analogfilter.h"
+
+#define STEP_FROM	0x80
+#define STEP_TO		0xff
+#define MAX_SAMPLES	1000
+#define NOISE_SAMPLES	10000
+
+typedef struct {
+	const char *name;
+	unsigned char mode;
+} filter_desc;
+
+static const filter_desc filters[] = {
+	{ "NONE", ANALOG_FILTER_NONE },
+	{ "MEDIAN3", ANALOG_FILTER_MEDIAN3 },
+	{ "EMA(1)", ANALOG_FILTER_EMA(1) },
+	{ "EMA(2)", ANALOG_FILTER_EMA(2) },
+	{ "EMA(3)", ANALOG_FILTER_EMA(3) },
+	{ "EMA(4)", ANALOG_FILTER_EMA(4) },
+	{ "MEDIAN3 | EMA(1)", ANALOG_FILTER_MEDIAN3 | ANALOG_FILTER_EMA(1) },
+	{ "MEDIAN3 | EMA(2)", ANALOG_FILTER_MEDIAN3 | ANALOG_FILTER_EMA(2) },
+	{ "MEDIAN3 | EMA(3)", ANALOG_FILTER_MEDIAN3 | ANALOG_FILTER_EMA(3) },
+};
+
+static unsigned char feed(unsigned char v)
+{
+	unsigned char axes[ANALOG_FILTER_AXES];
+	int i;
+
+	for (i=0; i<ANALOG_FILTER_AXES; i++)
+		axes[i] = v;
+	analogfilterApply(axes);
+
+	return axes[0];
+}
+
+static void setMode(unsigned char mode)
+{
+	unsigned char modes[ANALOG_FILTER_AXES];
+	int i;
+
+	for (i=0; i<ANALOG_FILTER_AXES; i++)
+		modes[i] = mode;
+	analogfilterInit(modes);
+}
+
+/* Samples after the step until the condition holds, -1 if never */
+static void stepResponse(unsigned char mode, int *first, int *half, int *p90, int *settled)
+{
+	int n, out;
+	int half_level = STEP_FROM + (STEP_TO - STEP_FROM) / 2;
+	int p90_level = STEP_FROM + (STEP_TO - STEP_FROM) * 9 / 10;
+
+	setMode(mode);
+	for (n=0; n<8; n++)
+		feed(STEP_FROM);
+
+	*first = *half = *p90 = *settled = -1;
+	for (n=0; n<MAX_SAMPLES; n++) {
+		out = feed(STEP_TO);
+		if (*first < 0 && out != STEP_FROM)
+			*first = n;
+		if (*half < 0 && out >= half_level)
+			*half = n;
+		if (*p90 < 0 && out >= p90_level)
+			*p90 = n;
+		if (out >= STEP_TO - 1) {
+			if (*settled < 0)
+				*settled = n;
+		} else {
+			*settled = -1;
+		}
+	}
+}
+
+static void noiseResponse(unsigned char mode, double *rms, int *peak, int *changes)
+{
+	int n, in, out, prev = 0x80;
+	double sum = 0;
+
+	srand(1);
+	setMode(mode);
+
+	*peak = 0;
+	*changes = 0;
+	for (n=0; n<NOISE_SAMPLES; n++) {
+		in = 0x80 + (rand() % 5) - 2;
+		if (rand() % 50 == 0)
+			in += (rand() & 1) ? 20 : -20;
+
+		out = feed(in);
+		sum += (out - 0x80) * (out - 0x80);
+		if (abs(out - 0x80) > *peak)
+			*peak = abs(out - 0x80);
+		if (out != prev)
+			(*changes)++;
+		prev = out;
+	}
+	*rms = sqrt(sum / NOISE_SAMPLES);
+}
+
+int main(int argc, char **argv)
+{
+	int rate = 500;
+	unsigned int i;
+	int first, half, p90, settled, peak, changes;
+	double rms, ms;
+
+	if (argc > 1)
+		rate = atoi(argv[1]);
+	if (rate <= 0) {
+		fprintf(stderr, "Usage: filtersim [sampling rate Hz]\n");
+		return 1;
+	}
+	ms = 1000.0 / rate;
+
+	printf("Step 0x%02x -> 0x%02x, samples (ms at %d Hz)\n", STEP_FROM, STEP_TO, rate);
+	printf("%-18s %12s %12s %12s %12s\n", "mode", "first", "50%", "90%", "settled");
+	for (i=0; i<sizeof(filters)/sizeof(filters[0]); i++) {
+		stepResponse(filters[i].mode, &first, &half, &p90, &settled);
+		printf("%-18s %3d (%5.1f) %3d (%5.1f) %3d (%5.1f) %3d (%5.1f)\n", filters[i].name,
+				first, first * ms, half, half * ms, p90, p90 * ms, settled, settled * ms);
+	}
+
+	printf("\nResting at 0x80, +/-2 LSB noise, 2%% spikes of 20 LSB, %d samples\n", NOISE_SAMPLES);
+	printf("%-18s %8s %8s %8s\n", "mode", "rms", "peak", "changes");
+	for (i=0; i<sizeof(filters)/sizeof(filters[0]); i++) {
+		noiseResponse(filters[i].mode, &rms, &peak, &changes);
+		printf("%-18s %8.2f %8d %8d\n", filters[i].name, rms, peak, changes);
+	}
+
+	return 0;
+}
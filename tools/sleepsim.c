@@ -0,0 +1,218 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Host-side simulation of the main loop sleep policies (SLEEP_POLICY),
+ * without WITH_SAMPLE_ISR.
+ *
+ * The bus is modeled as a low-speed keep-alive at the start of every
+ * 1 ms frame (short USB interrupt) and an interrupt IN transaction every
+ * host polling interval (long USB interrupt). Main loop passes take a
+ * random time. Sampling is due on the Timer1 tick grid.
+ *
+ * For each policy, the time from the due time to the start of the
+ * controller read (jitter), the average age of an input change when it
+ * is read, and the share of time the CPU is awake are reported.
+ *
+ * Usage: sleepsim [sampling rate Hz] [host poll interval ms] [read us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define F_CPU			12000000.0
+#define TICK_US			(1024 * 1000000.0 / F_CPU)
+
+#define SIM_US			10000000.0	// 10 seconds
+
+#define KEEPALIVE_ISR_US	6.0
+#define TRANSFER_ISR_US		110.0
+#define TRANSFER_OFFSET_US	30.0	// from the start of the frame
+
+#define PASS_MIN_US		10.0	// main loop pass without a sample
+#define PASS_MAX_US		50.0
+#define USBPOLL_MIN_US	5.0		// tasks ahead of the sample task
+#define USBPOLL_MAX_US	20.0
+#define SETTLE_US		100.0	// policy 0
+#define SLEEP_MIN_US	500.0	// policy 2
+#define WAKE_US			1.0		// timer wake-up and empty interrupt
+
+enum { POLICY_LEGACY, POLICY_NONE, POLICY_TIMED, NUM_POLICIES };
+
+static const char *policy_names[NUM_POLICIES] = {
+	"0 sleep+settle",
+	"1 never sleep",
+	"2 timed sleep",
+};
+
+static double poll_interval_us;
+
+static double frand(double min, double max)
+{
+	return min + (max - min) * (rand() / (double)RAND_MAX);
+}
+
+/* Start of the next USB interrupt at or after t, and its duration */
+static double nextUsbIrq(double t, double *len)
+{
+	double frame = floor(t / 1000.0) * 1000.0;
+	double transfer;
+
+	for (;;) {
+		if (frame >= t) {
+			*len = KEEPALIVE_ISR_US;
+			return frame;
+		}
+		if (fmod(frame, poll_interval_us) == 0) {
+			transfer = frame + TRANSFER_OFFSET_US;
+			if (transfer >= t) {
+				*len = TRANSFER_ISR_US;
+				return transfer;
+			}
+		}
+		frame += 1000.0;
+	}
+}
+
+/* Advance by 'work' microseconds of main loop code starting at t,
+ * stretched by the USB interrupts that come meanwhile. */
+static double run(double t, double work)
+{
+	double irq, len, end = t + work;
+
+	for (;;) {
+		irq = nextUsbIrq(t, &len);
+		if (irq >= end)
+			return end;
+		end += len;
+		t = irq + len;
+	}
+}
+
+typedef struct {
+	double late_sum, late_sq, late_max, late_min;
+	double age_sum;
+	double awake;
+	long samples;
+} result;
+
+static void simulate(int policy, double period_ticks, double read_us, result *r)
+{
+	double t = 0, due = 0, start, irq, len, wake;
+	double awake_since = 0, late;
+
+	r->late_sum = r->late_sq = r->age_sum = r->awake = 0;
+	r->late_max = 0;
+	r->late_min = 1e9;
+	r->samples = 0;
+
+	srand(1);
+
+	while (t < SIM_US) {
+		// one main loop pass: usbPoll, then the sample task if due
+		t = run(t, frand(USBPOLL_MIN_US, USBPOLL_MAX_US));
+
+		if (t >= due) {
+			if (policy == POLICY_LEGACY) {
+				// sleep until the next USB interrupt, then settle
+				r->awake += t - awake_since;
+				irq = nextUsbIrq(t, &len);
+				t = irq + len;
+				awake_since = irq;
+				t = run(t, SETTLE_US);
+			}
+
+			start = t;
+			late = start - due;
+			r->late_sum += late;
+			r->late_sq += late * late;
+			if (late > r->late_max)
+				r->late_max = late;
+			if (late < r->late_min)
+				r->late_min = late;
+			t = run(t, read_us);
+
+			// An input change uniformly distributed over the period
+			// before the due time waits on average half a period,
+			// plus the lateness, until the read completes.
+			r->age_sum += period_ticks * TICK_US / 2 + (t - due);
+			r->samples++;
+
+			due += period_ticks * TICK_US;
+			if (due < t)
+				due = t; // missed periods are skipped
+		}
+
+		t = run(t, frand(PASS_MIN_US, PASS_MAX_US) - USBPOLL_MAX_US / 2);
+
+		if (policy == POLICY_TIMED && due - t >= SLEEP_MIN_US) {
+			// sleep until the due time or a USB interrupt
+			r->awake += t - awake_since;
+			irq = nextUsbIrq(t, &len);
+			if (irq < due) {
+				t = irq + len;
+				awake_since = irq;
+			} else {
+				wake = due + WAKE_US;
+				awake_since = due;
+				t = wake;
+			}
+		}
+	}
+
+	r->awake += t - awake_since;
+	r->awake /= t;
+}
+
+int main(int argc, char **argv)
+{
+	int rate = 60, poll_ms = 10, p;
+	double read_us = 40, period_ticks, mean, sd;
+	result r;
+
+	if (argc > 1)
+		rate = atoi(argv[1]);
+	if (argc > 2)
+		poll_ms = atoi(argv[2]);
+	if (argc > 3)
+		read_us = atof(argv[3]);
+	if (rate <= 0 || poll_ms <= 0 || read_us <= 0) {
+		fprintf(stderr, "Usage: sleepsim [sampling rate Hz] [host poll interval ms] [read us]\n");
+		return 1;
+	}
+
+	poll_interval_us = poll_ms * 1000.0;
+	// as TIMEBASE_HZ_TO_TICKS()
+	period_ticks = floor((F_CPU / 1024) / rate);
+
+	printf("Sampling at %d Hz (%.0f ticks, %.1f us), host polls every %d ms, read takes %.0f us\n",
+			rate, period_ticks, period_ticks * TICK_US, poll_ms, read_us);
+	printf("%-16s %10s %10s %10s %10s %10s\n", "policy", "late avg", "late sd",
+			"jitter p-p", "input age", "awake");
+
+	for (p=0; p<NUM_POLICIES; p++) {
+		simulate(p, period_ticks, read_us, &r);
+		mean = r.late_sum / r.samples;
+		sd = sqrt(r.late_sq / r.samples - mean * mean);
+		printf("%-16s %7.1f us %7.1f us %7.1f us %7.0f us %9.1f%%\n", policy_names[p],
+				mean, sd, r.late_max - r.late_min, r.age_sum / r.samples, r.awake * 100);
+	}
+
+	return 0;
+}
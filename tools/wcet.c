@@ -0,0 +1,520 @@
+/* Saturn to USB : Sega saturn controllers to USB adapter
+ * Copyright (C) 2011-2013 Raphal Assnat
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The author may be contacted at raph@raphnet.net
+ */
+/*
+ * Worst-case execution time of the firmware main loop, measured on the
+ * built ELF in simavr while controller models answer the TH/TR lines.
+ *
+ * Build: make wcet (needs simavr and libelf)
+ * Usage: wcet [-m mcu] [-f hz] [-t ms] [-l limit_ms] [-s seed] firmware.elf
+ *
+ *   make wcet                           (main.bin, ATmega8)
+ *   make -f Makefile.atmega168 wcet     (saturn_usb.m168.elf)
+ *
+ * Function entries are found by the program counter reaching the
+ * address of their symbol, returns by the stack pointer rising above
+ * its value at entry. Cycle counts include the interrupts taken in the
+ * meantime. The ELF is the release build, so only functions that keep
+ * a symbol in it are probed: the task entry points, which the task table
+ * calls through pointers, the Gamepad hooks and the functions of other
+ * modules. The controller capture (saturnCapture() and the static
+ * functions below it, inlined at -Os) is timed as part of taskSample(),
+ * the stalling models cover its waitTL() timeout paths. A probe whose
+ * symbol is missing anyway is listed as such.
+ *
+ * The USB interrupt is not simulated, only its effects on the main
+ * loop:
+ *  - A CPU asleep at the start of a 1 ms frame is woken, as the bus
+ *    keep-alive would.
+ *  - Every bInterval ms the interrupt endpoints are marked as collected
+ *    (usbTxLen = NAK), so the send path runs at the host polling rate.
+ * The bus traffic itself adds to the gaps measured here, so the limit
+ * should keep some margin.
+ *
+ * Exits with status 1 if, for any model, the longest gap between two
+ * usbPoll() calls exceeds the limit. The default limit is the interrupt
+ * endpoint interval from the configuration descriptor in the firmware.
+ * The adapter has a single port, so there is no multitap to add to it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <gelf.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <sim_irq.h>
+#include <sim_time.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+
+#define USBPID_NAK			0x5a
+#define DATA_OFFSET			0x800000	// data addresses in AVR ELF files
+
+// bInterval in my_usbDescriptorConfiguration (config, interface and
+// HID descriptors, then byte 6 of the endpoint descriptor)
+#define CONFIG_INTERVAL_OFFSET	(9 + 9 + 9 + 6)
+
+/* ------------------------------------------------------------------------- */
+/* Symbols                                                                   */
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+	const char *name;
+	long addr;				// -1: not found (inlined or not built)
+	int active;
+	uint16_t sp;
+	avr_cycle_count_t start;
+	unsigned long calls;
+	avr_cycle_count_t max;
+} Probe;
+
+static Probe probes[] = {
+	{ "usbPoll" },
+	{ "tasksRun" },
+	{ "taskUsb" },
+	{ "taskSample" },
+	{ "saturnUpdate" },
+	{ "saturnDecodePad" },
+	{ "saturnDecodeAnalog" },
+	{ "saturnDecodeMouse" },
+	{ "analogcalApply" },
+	{ "analogfilterApply" },
+	{ "taskSubmit" },
+	{ "saturnTakeReport" },
+	{ "saturnBuildReport" },
+	{ "crccacheSetInterrupt" },
+	{ "usbSetInterrupt" },
+	{ "taskTelemetry" },
+	{ "telemetryStream" },
+};
+#define NUM_PROBES	(sizeof(probes) / sizeof(probes[0]))
+#define PROBE_USBPOLL	0
+
+typedef struct {
+	const char *name;
+	long addr; // in SRAM, -1 if not found
+} DataSymbol;
+
+static DataSymbol tx_len1 = { "usbTxLen1", -1 };
+static DataSymbol tx_len3 = { "usbTxLen3", -1 };
+static DataSymbol config_desc = { "my_usbDescriptorConfiguration", -1 };
+
+static int loadSymbols(const char *path)
+{
+	Elf *e;
+	Elf_Scn *scn = NULL;
+	Elf_Data *data;
+	GElf_Shdr shdr;
+	GElf_Sym sym;
+	const char *name;
+	size_t i, j, n;
+	int fd;
+
+	for (j=0; j<NUM_PROBES; j++)
+		probes[j].addr = -1;
+
+	if (elf_version(EV_CURRENT) == EV_NONE)
+		return -1;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	e = elf_begin(fd, ELF_C_READ, NULL);
+	if (!e) {
+		fprintf(stderr, "%s: %s\n", path, elf_errmsg(-1));
+		close(fd);
+		return -1;
+	}
+
+	while ((scn = elf_nextscn(e, scn)) != NULL) {
+		if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_SYMTAB)
+			continue;
+		data = elf_getdata(scn, NULL);
+		n = shdr.sh_size / shdr.sh_entsize;
+
+		for (i=0; i<n; i++) {
+			if (!gelf_getsym(data, i, &sym))
+				continue;
+			name = elf_strptr(e, shdr.sh_link, sym.st_name);
+			if (!name)
+				continue;
+
+			if (GELF_ST_TYPE(sym.st_info) == STT_FUNC) {
+				for (j=0; j<NUM_PROBES; j++) {
+					if (!strcmp(name, probes[j].name))
+						probes[j].addr = sym.st_value;
+				}
+			} else if (GELF_ST_TYPE(sym.st_info) == STT_OBJECT) {
+				if (!strcmp(name, tx_len1.name))
+					tx_len1.addr = sym.st_value - DATA_OFFSET;
+				if (!strcmp(name, tx_len3.name))
+					tx_len3.addr = sym.st_value - DATA_OFFSET;
+				if (!strcmp(name, config_desc.name))
+					config_desc.addr = sym.st_value - DATA_OFFSET;
+			}
+		}
+	}
+
+	elf_end(e);
+	close(fd);
+
+	if (probes[PROBE_USBPOLL].addr < 0) {
+		fprintf(stderr, "%s: no usbPoll symbol\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Controller models                                                         */
+/* ------------------------------------------------------------------------- */
+
+/* Lines as seen by getDat() in saturn.c: bit 0-3 D0-D3 (PC3-PC0),
+ * bit 4 TL (PB5). */
+static avr_irq_t *irq_d[4], *irq_tl;
+
+static void setLines(unsigned char v)
+{
+	avr_raise_irq(irq_d[0], (v >> 0) & 1);
+	avr_raise_irq(irq_d[1], (v >> 1) & 1);
+	avr_raise_irq(irq_d[2], (v >> 2) & 1);
+	avr_raise_irq(irq_d[3], (v >> 3) & 1);
+	avr_raise_irq(irq_tl, (v >> 4) & 1);
+}
+
+typedef struct {
+	const char *name;
+	char handshake;				// 0: multiplexed pad
+	unsigned char id;			// nibble with TH and TR high
+	unsigned char id_byte;		// first two handshake nibbles
+	unsigned char length;		// handshake nibbles, ID included
+	unsigned char stall_at;		// stop answering at this nibble, 0: never
+} Model;
+
+static const Model models[] = {
+	{ "none",			0, 0x1F },
+	{ "pad",			0, 0x14 },
+	{ "3d-analog",		1, 0x11, 0x16, 14 },
+	{ "3d-digital",		1, 0x11, 0x02, 8 },
+	{ "mouse",			1, 0x10, 0xE3, 8 },
+	// waitTL() timeouts: late in the frame is the longest case
+	{ "3d-stall",		1, 0x11, 0x16, 14, 13 },
+	{ "mouse-stall",	1, 0x10, 0xE3, 8, 7 },
+	{ "3d-stall-early",	1, 0x11, 0x16, 14, 1 },
+};
+#define NUM_MODELS	(sizeof(models) / sizeof(models[0]))
+
+static const Model *model;
+static int th = 1, tr = 1;
+static unsigned char frame[14];
+static unsigned char pos;
+
+/* New random controller state for the next read */
+static void newFrame(void)
+{
+	unsigned char i;
+
+	frame[0] = model->id_byte >> 4;
+	frame[1] = model->id_byte & 0x0f;
+	for (i=2; i<sizeof(frame); i++)
+		frame[i] = rand() & 0x0f;
+	// digital pad L button in the ID nibble
+	if (!model->handshake && model->id == 0x14 && (rand() & 1))
+		frame[0] = 0x08;
+	pos = 0;
+}
+
+static void modelUpdate(void)
+{
+	unsigned char d;
+
+	if (!model->handshake) {
+		if (model->id != 0x14) {
+			setLines(model->id); // nothing connected: pull-ups
+			return;
+		}
+		// TH TR: 11 ID (1L100), 00 Z Y X R, 10 B C A St, 01 Up Dn Lt Rt
+		if (th && tr)
+			d = 0x14 | frame[0];
+		else if (!th && !tr)
+			d = frame[2];
+		else if (th)
+			d = frame[3];
+		else
+			d = frame[4];
+		setLines(0x10 | d);
+		return;
+	}
+
+	// With TH low, the TR edges drive the handshake (see onSelect)
+	if (th)
+		setLines(model->id);
+}
+
+static void onSelect(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	int line = (int)(long)param;
+	int old_th = th;
+
+	// A notification may repeat the current level, only act on edges
+	if (line == 5) {
+		if (th == (int)value)
+			return;
+		th = value;
+	} else {
+		if (tr == (int)value)
+			return;
+		tr = value;
+	}
+
+	if (model->handshake) {
+		if (line == 5) {
+			if (th && !old_th)
+				newFrame();
+			if (!th)
+				pos = 0;
+			modelUpdate();
+			return;
+		}
+		// TR toggled: next nibble, TL follows TR
+		if (!th && pos < model->length) {
+			if (model->stall_at && pos >= model->stall_at)
+				return;
+			setLines((tr ? 0x10 : 0) | frame[pos]);
+			pos++;
+		}
+		return;
+	}
+
+	if (line == 5 && th && !old_th)
+		newFrame();
+	modelUpdate();
+}
+
+/* ------------------------------------------------------------------------- */
+/* Simulation                                                                */
+/* ------------------------------------------------------------------------- */
+
+static unsigned char poll_interval;	// bInterval, read once .data is set up
+static unsigned long ms;
+static unsigned long keepalive_wakes;
+
+static avr_cycle_count_t frameTick(struct avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	ms++;
+
+	if (avr->state == cpu_Sleeping) {
+		avr->state = cpu_Running;
+		keepalive_wakes++;
+	}
+
+	if (poll_interval && (ms % poll_interval) == 0) {
+		if (tx_len1.addr >= 0)
+			avr->data[tx_len1.addr] = USBPID_NAK;
+		if (tx_len3.addr >= 0)
+			avr->data[tx_len3.addr] = USBPID_NAK;
+	}
+
+	return when + avr_usec_to_cycles(avr, 1000);
+}
+
+static void trace(avr_t *avr, avr_cycle_count_t *gap_max, avr_cycle_count_t *last_poll)
+{
+	uint16_t sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+	avr_cycle_count_t t;
+	unsigned int i;
+	Probe *p;
+
+	for (i=0; i<NUM_PROBES; i++) {
+		p = &probes[i];
+
+		if (p->active && sp > p->sp) {
+			p->active = 0;
+			t = avr->cycle - p->start;
+			if (t > p->max)
+				p->max = t;
+		}
+
+		if (!p->active && (long)avr->pc == p->addr) {
+			p->active = 1;
+			p->sp = sp;
+			p->start = avr->cycle;
+			p->calls++;
+
+			if (i == PROBE_USBPOLL) {
+				if (*last_poll && avr->cycle - *last_poll > *gap_max)
+					*gap_max = avr->cycle - *last_poll;
+				*last_poll = avr->cycle;
+				if (!poll_interval && config_desc.addr >= 0)
+					poll_interval = avr->data[config_desc.addr + CONFIG_INTERVAL_OFFSET];
+			}
+		}
+	}
+}
+
+/* \return the longest gap between usbPoll() calls in cycles, or 0 if
+ * the simulation failed */
+static avr_cycle_count_t simulate(elf_firmware_t *fw, unsigned long duration_ms)
+{
+	avr_cycle_count_t gap_max = 0, last_poll = 0, end;
+	avr_t *avr;
+	unsigned int i;
+	int state;
+
+	avr = avr_make_mcu_by_name(fw->mmcu);
+	if (!avr) {
+		fprintf(stderr, "unknown mcu %s\n", fw->mmcu);
+		return 0;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, fw);
+
+	for (i=0; i<4; i++)
+		irq_d[i] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 3 - i);
+	irq_tl = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 5);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 5),
+							onSelect, (void*)5L);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 4),
+							onSelect, (void*)4L);
+
+	for (i=0; i<NUM_PROBES; i++) {
+		probes[i].active = 0;
+		probes[i].calls = 0;
+		probes[i].max = 0;
+	}
+	th = tr = 1;
+	ms = 0;
+	keepalive_wakes = 0;
+	poll_interval = 0;
+	newFrame();
+	modelUpdate();
+
+	avr_cycle_timer_register_usec(avr, 1000, frameTick, NULL);
+
+	end = avr_usec_to_cycles(avr, duration_ms * 1000UL);
+	while (avr->cycle < end) {
+		state = avr_run(avr);
+		if (state == cpu_Done || state == cpu_Crashed) {
+			fprintf(stderr, "%s: simulation stopped at pc 0x%04x\n", model->name, (unsigned)avr->pc);
+			avr_terminate(avr);
+			return 0;
+		}
+		trace(avr, &gap_max, &last_poll);
+	}
+
+	avr_terminate(avr);
+	return gap_max;
+}
+
+static double toUs(avr_cycle_count_t c, uint32_t freq)
+{
+	return c * 1000000.0 / freq;
+}
+
+int main(int argc, char **argv)
+{
+	elf_firmware_t fw;
+	const char *mcu = NULL;
+	uint32_t freq = 0;
+	unsigned long duration_ms = 2000;
+	double limit_ms = 0, worst_ms = 0, gap_ms;
+	avr_cycle_count_t gap;
+	unsigned int m, i;
+	int opt, failed = 0;
+	unsigned int seed = 1;
+
+	while ((opt = getopt(argc, argv, "m:f:t:l:s:")) != -1) {
+		switch (opt)
+		{
+			case 'm': mcu = optarg; break;
+			case 'f': freq = strtoul(optarg, NULL, 0); break;
+			case 't': duration_ms = strtoul(optarg, NULL, 0); break;
+			case 'l': limit_ms = atof(optarg); break;
+			case 's': seed = strtoul(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "Usage: wcet [-m mcu] [-f hz] [-t ms] [-l limit_ms] [-s seed] firmware.elf\n");
+				return 2;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: wcet [-m mcu] [-f hz] [-t ms] [-l limit_ms] [-s seed] firmware.elf\n");
+		return 2;
+	}
+
+	if (loadSymbols(argv[optind]))
+		return 2;
+
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[optind], &fw)) {
+		fprintf(stderr, "%s: cannot load\n", argv[optind]);
+		return 2;
+	}
+	if (mcu)
+		snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", mcu);
+	else if (!fw.mmcu[0])
+		strcpy(fw.mmcu, "atmega8");
+	if (freq)
+		fw.frequency = freq;
+	else if (!fw.frequency)
+		fw.frequency = 12000000;
+
+	printf("%s, %s at %u Hz, %lu ms per model\n", argv[optind], fw.mmcu,
+			(unsigned)fw.frequency, duration_ms);
+
+	for (m=0; m<NUM_MODELS; m++) {
+		model = &models[m];
+		srand(seed);
+
+		gap = simulate(&fw, duration_ms);
+		if (!gap) {
+			failed = 1;
+			continue;
+		}
+
+		printf("\nModel %s (%lu keep-alive wake-ups)\n", model->name, keepalive_wakes);
+		printf("  %-22s %8s %12s %10s\n", "function", "calls", "max cycles", "max us");
+		for (i=0; i<NUM_PROBES; i++) {
+			if (probes[i].addr < 0) {
+				printf("  %-22s %8s\n", probes[i].name, "no symbol");
+				continue;
+			}
+			printf("  %-22s %8lu %12llu %10.1f\n", probes[i].name, probes[i].calls,
+					(unsigned long long)probes[i].max, toUs(probes[i].max, fw.frequency));
+		}
+
+		gap_ms = toUs(gap, fw.frequency) / 1000.0;
+		printf("  longest usbPoll() gap: %llu cycles, %.3f ms\n", (unsigned long long)gap, gap_ms);
+		if (gap_ms > worst_ms)
+			worst_ms = gap_ms;
+	}
+
+	if (!limit_ms)
+		limit_ms = poll_interval ? poll_interval : 10;
+
+	printf("\nLongest usbPoll() gap %.3f ms, limit %.3f ms: %s\n", worst_ms, limit_ms,
+			worst_ms <= limit_ms && !failed ? "OK" : "FAIL");
+
+	return worst_ms <= limit_ms && !failed ? 0 : 1;
+}
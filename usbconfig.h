@@ -1,18 +1,20 @@
 #ifndef __usbconfig_h_included__
 #define __usbconfig_h_included__
 
+#include "config.h"
+
 #define USB_CFG_IOPORTNAME      D
 #define USB_CFG_DMINUS_BIT      0
 #define USB_CFG_DPLUS_BIT       2
 #define USB_CFG_CLOCK_KHZ       (F_CPU/1000)
 #define USB_CFG_HAVE_INTRIN_ENDPOINT    1
-#define USB_CFG_HAVE_INTRIN_ENDPOINT3   0
+#define USB_CFG_HAVE_INTRIN_ENDPOINT3   WITH_TELEMETRY_STREAM
 #define USB_CFG_IMPLEMENT_HALT          0
 #define USB_CFG_INTR_POLL_INTERVAL      10
 #define USB_CFG_IS_SELF_POWERED         0
 #define USB_CFG_MAX_BUS_POWER           100
 #define USB_CFG_IMPLEMENT_FN_WRITE      0
-#define USB_CFG_IMPLEMENT_FN_READ       0
+#define USB_CFG_IMPLEMENT_FN_READ       1
 #define USB_CFG_IMPLEMENT_FN_WRITEOUT   0
 #define USB_CFG_HAVE_FLOWCONTROL        0
 #define USB_COUNT_SOF                   0